@@ -0,0 +1,68 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "AtomicFile.h"
+
+#include <QDir>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+
+QString AtomicFile::temp_name(const QString &target)
+{
+    return target + ".tmp";
+}
+
+bool AtomicFile::commit(QFile &tmp_file, const QString &target)
+{
+    // the data has to be on the disk before the rename .. otherwise a crash
+    // can leave the new name pointing to an empty file
+    bool ok = tmp_file.flush();
+#ifdef Q_OS_WIN
+    ok = ok && _commit(tmp_file.handle()) == 0;
+#else
+    ok = ok && fsync(tmp_file.handle()) == 0;
+#endif
+    tmp_file.close();
+    ok = ok && tmp_file.error() == QFile::NoError;
+
+    // replace the target in one step .. there is no moment without it
+    if (ok) {
+#ifdef Q_OS_WIN
+        ok = MoveFileExW(reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(tmp_file.fileName()).utf16()),
+            reinterpret_cast<const wchar_t *>(QDir::toNativeSeparators(target).utf16()),
+            MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        ok = ::rename(QFile::encodeName(tmp_file.fileName()).constData(),
+            QFile::encodeName(target).constData()) == 0;
+#endif
+    }
+
+    if (!ok)
+        tmp_file.remove();
+    return ok;
+}
@@ -0,0 +1,43 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef AtomicFile_H
+#define AtomicFile_H
+
+#include <QFile>
+#include <QString>
+
+// files are written to a temporary file next to the target which then
+// replaces the target in one step .. whatever happens, the target is
+// either the old or the new version
+class AtomicFile
+{
+public:
+    // the name of the temporary file for the given target
+    static QString temp_name(const QString &target);
+
+    // flushes the (written) temporary file to disk and moves it over the
+    // target .. on failure the temporary file is removed and the target
+    // stays untouched
+    static bool commit(QFile &tmp_file, const QString &target);
+};
+
+#endif
@@ -29,12 +29,42 @@ SOURCES += main.cpp\
         mainwindow.cpp \
     ImgAnnotation.cpp \
     PixmapWidget.cpp \
-    ScrollAreaNoWheel.cpp
+    ScrollAreaNoWheel.cpp \
+    MaskIndex.cpp \
+    MaskComponents.cpp \
+    MaskContours.cpp \
+    MaskPyramid.cpp \
+    ImageLoader.cpp \
+    MemoryBudget.cpp \
+    MaskWorkingSet.cpp \
+    MaskClassSchema.cpp \
+    ThumbnailLoader.cpp \
+    ImageTreeModel.cpp \
+    MagicWand.cpp \
+    ImageEnhancer.cpp \
+    LiveWire.cpp \
+    Superpixels.cpp \
+    AtomicFile.cpp
 
 HEADERS  += mainwindow.h \
     defines.h \
     ImgAnnotation.h \
     PixmapWidget.h \
-    ScrollAreaNoWheel.h
+    ScrollAreaNoWheel.h \
+    MaskIndex.h \
+    MaskComponents.h \
+    MaskContours.h \
+    MaskPyramid.h \
+    ImageLoader.h \
+    MemoryBudget.h \
+    MaskWorkingSet.h \
+    MaskClassSchema.h \
+    ThumbnailLoader.h \
+    ImageTreeModel.h \
+    MagicWand.h \
+    ImageEnhancer.h \
+    LiveWire.h \
+    Superpixels.h \
+    AtomicFile.h
 
 FORMS    += mainwindow.ui
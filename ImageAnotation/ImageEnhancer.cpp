@@ -0,0 +1,292 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "ImageEnhancer.h"
+
+#include <QRunnable>
+#include <math.h>
+#include <string.h>
+
+
+// ========== EnhanceCellTask ==========
+
+// the CLAHE mappings of one row of cells .. the tiles are started once all
+// rows are done
+class EnhanceCellTask : public QRunnable
+{
+public:
+    EnhanceCellTask(ImageEnhancer *enhancer, int run, QSharedPointer<ImageEnhancer::Job> job, int row)
+        : _enhancer(enhancer), _run(run), _job(job), _row(row) {}
+
+    void run()
+    {
+        if (_enhancer->_run == _run)
+        {
+            const QImage &picture = _job->picture;
+            for (int column = 0; column < _job->columns; ++column)
+            {
+                QRect cell(column * CLAHE_CELL_SIZE, _row * CLAHE_CELL_SIZE, CLAHE_CELL_SIZE, CLAHE_CELL_SIZE);
+                cell &= picture.rect();
+
+                int histogram[256];
+                memset(histogram, 0, sizeof(histogram));
+                for (int y = cell.top(); y <= cell.bottom(); ++y)
+                {
+                    const QRgb *line = reinterpret_cast<const QRgb *>(picture.constScanLine(y));
+                    for (int x = cell.left(); x <= cell.right(); ++x)
+                        histogram[qGreen(line[x])]++;
+                }
+
+                // clip the histogram and spread what is above the limit over
+                // all bins .. this limits the contrast gain in flat regions
+                const int count = cell.width() * cell.height();
+                const int limit = qMax(1, int(CLAHE_CLIP_LIMIT * count / 256));
+                int excess = 0;
+                for (int i = 0; i < 256; ++i)
+                {
+                    if (histogram[i] > limit)
+                    {
+                        excess += histogram[i] - limit;
+                        histogram[i] = limit;
+                    }
+                }
+                for (int i = 0; i < 256; ++i)
+                    histogram[i] += excess / 256 + (i < excess % 256 ? 1 : 0);
+
+                uchar *mapping = _job->mappings.data() + (_row * _job->columns + column) * 256;
+                int sum = 0;
+                for (int i = 0; i < 256; ++i)
+                {
+                    sum += histogram[i];
+                    mapping[i] = uchar(qMin(255, sum * 255 / count));
+                }
+            }
+        }
+
+        QMetaObject::invokeMethod(_enhancer, "slot_cells_done_i", Qt::QueuedConnection, Q_ARG(int, _run));
+    }
+
+private:
+    ImageEnhancer *_enhancer;
+    int _run;
+    QSharedPointer<ImageEnhancer::Job> _job;
+    int _row;
+};
+
+
+// ========== EnhanceTileTask ==========
+
+// one tile of the view .. sent back to the enhancer with a queued call
+class EnhanceTileTask : public QRunnable
+{
+public:
+    EnhanceTileTask(ImageEnhancer *enhancer, int run, QSharedPointer<ImageEnhancer::Job> job, const QRect &rect)
+        : _enhancer(enhancer), _run(run), _job(job), _rect(rect) {}
+
+    void run()
+    {
+        // the user already moved on to another image or view
+        if (_enhancer->_run != _run)
+            return;
+
+        QImage tile = ImageEnhancer::gray_image(_rect.size());
+        if (_job->mode == ImageEnhancer::GreenClahe)
+            clahe_i(tile);
+        else
+            green_i(tile);
+
+        QMetaObject::invokeMethod(_enhancer, "slot_tile_done_i", Qt::QueuedConnection,
+            Q_ARG(int, _run), Q_ARG(QRect, _rect), Q_ARG(QImage, tile));
+    }
+
+private:
+    void green_i(QImage &tile)
+    {
+        for (int y = 0; y < _rect.height(); ++y)
+        {
+            const QRgb *src = reinterpret_cast<const QRgb *>(_job->picture.constScanLine(_rect.y() + y)) + _rect.x();
+            uchar *dst = tile.scanLine(y);
+            for (int x = 0; x < _rect.width(); ++x)
+                dst[x] = uchar(qGreen(src[x]));
+        }
+    }
+
+    void clahe_i(QImage &tile)
+    {
+        // every pixel interpolates the mappings of the four nearest cell
+        // centers (fixed point weights) .. the columns are prepared once
+        const int columns = _job->columns;
+        const int rows = _job->rows;
+        QVector<int> left(_rect.width()), right(_rect.width()), weight(_rect.width());
+        for (int x = 0; x < _rect.width(); ++x)
+            cell_i(_rect.x() + x, columns, left[x], right[x], weight[x]);
+
+        const uchar *mappings = _job->mappings.constData();
+        for (int y = 0; y < _rect.height(); ++y)
+        {
+            int top, bottom, wy;
+            cell_i(_rect.y() + y, rows, top, bottom, wy);
+            const uchar *upper = mappings + top * columns * 256;
+            const uchar *lower = mappings + bottom * columns * 256;
+
+            const QRgb *src = reinterpret_cast<const QRgb *>(_job->picture.constScanLine(_rect.y() + y)) + _rect.x();
+            uchar *dst = tile.scanLine(y);
+            for (int x = 0; x < _rect.width(); ++x)
+            {
+                int v = qGreen(src[x]);
+                int l = left[x] * 256 + v;
+                int r = right[x] * 256 + v;
+                int wx = weight[x];
+                int a = upper[l] * (256 - wx) + upper[r] * wx;
+                int b = lower[l] * (256 - wx) + lower[r] * wx;
+                dst[x] = uchar((a * (256 - wy) + b * wy) >> 16);
+            }
+        }
+    }
+
+    static void cell_i(int pos, int count, int &first, int &second, int &weight)
+    {
+        // the cells whose centers are around pos and the weight of the second
+        double c = (pos + 0.5) / CLAHE_CELL_SIZE - 0.5;
+        first = int(floor(c));
+        weight = int((c - first) * 256);
+        if (first < 0)
+        {
+            first = 0;
+            weight = 0;
+        }
+        if (first >= count - 1)
+        {
+            first = count - 1;
+            weight = 0;
+        }
+        second = qMin(first + 1, count - 1);
+    }
+
+private:
+    ImageEnhancer *_enhancer;
+    int _run;
+    QSharedPointer<ImageEnhancer::Job> _job;
+    QRect _rect;
+};
+
+
+// ========== ImageEnhancer ==========
+
+ImageEnhancer::ImageEnhancer(QObject *parent)
+    : QObject(parent)
+{
+    // the tiles are independent .. all cores work on them
+    _run = 0;
+    _pending = 0;
+}
+
+ImageEnhancer::~ImageEnhancer()
+{
+    cancel();
+    _pool.waitForDone();
+}
+
+QImage ImageEnhancer::gray_image(const QSize &size)
+{
+    QVector<QRgb> table(256);
+    for (int i = 0; i < 256; ++i)
+        table[i] = qRgb(i, i, i);
+    QImage image(size, QImage::Format_Indexed8);
+    image.setColorTable(table);
+    return image;
+}
+
+void ImageEnhancer::start(const QString &image, const QImage &picture, Mode mode)
+{
+    cancel();
+    if (mode == Original || picture.isNull())
+        return;
+
+    _image = image;
+    _job = QSharedPointer<Job>(new Job());
+    _job->picture = picture;
+    if (picture.format() != QImage::Format_RGB32 && picture.format() != QImage::Format_ARGB32 && picture.format() != QImage::Format_ARGB32_Premultiplied)
+        _job->picture = picture.convertToFormat(QImage::Format_RGB32);
+    _job->mode = mode;
+    _job->columns = (picture.width() + CLAHE_CELL_SIZE - 1) / CLAHE_CELL_SIZE;
+    _job->rows = (picture.height() + CLAHE_CELL_SIZE - 1) / CLAHE_CELL_SIZE;
+
+    if (mode == GreenClahe)
+    {
+        // the cell mappings first
+        _job->mappings.resize(_job->columns * _job->rows * 256);
+        _pending = _job->rows;
+        for (int row = 0; row < _job->rows; ++row)
+            _pool.start(new EnhanceCellTask(this, _run, _job, row));
+    }
+    else
+    {
+        start_tiles_i();
+    }
+}
+
+void ImageEnhancer::cancel()
+{
+    // does not block .. queued tasks are skipped and the results of the
+    // running ones are dropped
+    _run++;
+    _pending = 0;
+    _job.clear();
+}
+
+void ImageEnhancer::start_tiles_i()
+{
+    const QImage &picture = _job->picture;
+    _pending = 0;
+    for (int y = 0; y < picture.height(); y += ENHANCE_TILE_SIZE)
+    {
+        for (int x = 0; x < picture.width(); x += ENHANCE_TILE_SIZE)
+        {
+            QRect rect = QRect(x, y, ENHANCE_TILE_SIZE, ENHANCE_TILE_SIZE) & picture.rect();
+            _pool.start(new EnhanceTileTask(this, _run, _job, rect));
+            _pending++;
+        }
+    }
+}
+
+void ImageEnhancer::slot_cells_done_i(int run)
+{
+    if (run != _run)
+        return;
+
+    if (--_pending == 0)
+        start_tiles_i();
+}
+
+void ImageEnhancer::slot_tile_done_i(int run, const QRect &rect, const QImage &tile)
+{
+    if (run != _run)
+        return;
+
+    int mode = _job->mode;
+    emit tile_ready(_image, mode, rect, tile);
+    if (--_pending == 0)
+    {
+        _job.clear();
+        emit finished(_image, mode);
+    }
+}
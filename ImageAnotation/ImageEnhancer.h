@@ -0,0 +1,96 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef ImageEnhancer_H
+#define ImageEnhancer_H
+
+#include <QObject>
+#include <QString>
+#include <QImage>
+#include <QRect>
+#include <QVector>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+// edge length of the tiles a view is computed (and shown) in
+#define ENHANCE_TILE_SIZE 512
+// CLAHE equalizes the histograms of cells of this size ..
+#define CLAHE_CELL_SIZE 256
+// .. after clipping them at this multiple of the mean bin
+#define CLAHE_CLIP_LIMIT 3.0
+
+
+// the enhanced views graders label on .. the green channel of the fundus
+// image as it is or contrast limited equalized (CLAHE). the views are
+// computed in tiles on worker threads and handed out tile by tile
+class ImageEnhancer : public QObject
+{
+    Q_OBJECT
+
+public:
+    // the order of the view combo box
+    enum Mode { Original, GreenChannel, GreenClahe };
+
+public:
+    ImageEnhancer(QObject *parent = 0);
+    virtual ~ImageEnhancer();
+
+    // an Indexed8 image with a gray colour table
+    static QImage gray_image(const QSize &size);
+
+    void start(const QString &image, const QImage &picture, Mode mode);
+    void cancel();
+
+signals:
+    void tile_ready(const QString &image, int mode, const QRect &rect, const QImage &tile);
+    void finished(const QString &image, int mode);
+
+private slots:
+    void slot_cells_done_i(int run);
+    void slot_tile_done_i(int run, const QRect &rect, const QImage &tile);
+
+private:
+    // what the tasks of one run share .. the picture and the cell mappings
+    class Job
+    {
+    public:
+        QImage picture;
+        Mode mode;
+        int columns;
+        int rows;
+        // 256 entries per cell, row by row
+        QVector<uchar> mappings;
+    };
+
+    void start_tiles_i();
+
+private:
+    friend class EnhanceCellTask;
+    friend class EnhanceTileTask;
+
+    QThreadPool _pool;
+    volatile int _run;
+    QString _image;
+    QSharedPointer<Job> _job;
+    int _pending;
+};
+
+#endif
@@ -0,0 +1,116 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "ImageLoader.h"
+
+#include <QImageReader>
+#include <QImageIOHandler>
+#include <QRunnable>
+#include "defines.h"
+
+
+// ========== ImageLoadTask ==========
+
+// decodes one image .. the result is sent back to the loader with a
+// queued call, images requested later make it obsolete
+class ImageLoadTask : public QRunnable
+{
+public:
+    ImageLoadTask(ImageLoader *loader, int run, const QString &file)
+        : _loader(loader), _run(run), _file(file) {}
+
+    void run()
+    {
+        // the user already moved on to another image
+        if (_loader->_run != _run)
+            return;
+
+        QImage image(_file);
+        QMetaObject::invokeMethod(_loader, "slot_image_done_i", Qt::QueuedConnection,
+            Q_ARG(int, _run), Q_ARG(QString, _file), Q_ARG(QImage, image));
+    }
+
+private:
+    ImageLoader *_loader;
+    int _run;
+    QString _file;
+};
+
+
+// ========== ImageLoader ==========
+
+ImageLoader::ImageLoader(QObject *parent)
+    : QObject(parent)
+{
+    // one image at a time .. a newer request makes the queued ones obsolete
+    _pool.setMaxThreadCount(1);
+    _run = 0;
+}
+
+ImageLoader::~ImageLoader()
+{
+    cancel();
+    _pool.waitForDone();
+}
+
+QImage ImageLoader::read_preview(const QString &file, int max_size, QSize &image_size)
+{
+    // the size is read from the header only
+    QImageReader reader(file);
+    image_size = reader.size();
+    if (!image_size.isValid())
+        return QImage();
+
+    // small images are decoded right away
+    if (MAX(image_size.width(), image_size.height()) <= max_size)
+        return reader.read();
+
+    // formats which can not decode reduced (e.g. jpeg can, tiff can not)
+    // would be decoded in full here .. leave them to the worker
+    if (!reader.supportsOption(QImageIOHandler::ScaledSize))
+        return QImage();
+
+    QSize scaled_size = image_size;
+    scaled_size.scale(max_size, max_size, Qt::KeepAspectRatio);
+    reader.setScaledSize(scaled_size);
+    return reader.read();
+}
+
+void ImageLoader::start(const QString &file)
+{
+    _run++;
+    _pool.start(new ImageLoadTask(this, _run, file));
+}
+
+void ImageLoader::cancel()
+{
+    // does not block .. queued images are skipped and the result of the one
+    // being decoded is dropped
+    _run++;
+}
+
+void ImageLoader::slot_image_done_i(int run, const QString &file, const QImage &image)
+{
+    if (run != _run)
+        return;
+
+    emit loaded(file, image);
+}
@@ -0,0 +1,62 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef ImageLoader_H
+#define ImageLoader_H
+
+#include <QObject>
+#include <QString>
+#include <QImage>
+#include <QSize>
+#include <QThreadPool>
+
+// longest side of the preview shown while the full image is decoded
+#define IMAGE_PREVIEW_SIZE 1024
+
+// decodes images in full resolution on a worker thread .. a quick reduced
+// decode for the first paint is done by read_preview
+class ImageLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    ImageLoader(QObject *parent = 0);
+    virtual ~ImageLoader();
+
+    static QImage read_preview(const QString &file, int max_size, QSize &image_size);
+
+    void start(const QString &file);
+    void cancel();
+
+signals:
+    void loaded(const QString &file, const QImage &image);
+
+private slots:
+    void slot_image_done_i(int run, const QString &file, const QImage &image);
+
+private:
+    friend class ImageLoadTask;
+
+    QThreadPool _pool;
+    volatile int _run;
+};
+
+#endif
@@ -0,0 +1,439 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "ImageTreeModel.h"
+#include <QtAlgorithms>
+
+
+ImageTreeModel::ImageTreeModel(QObject *parent)
+    : QAbstractItemModel(parent)
+{
+}
+
+void ImageTreeModel::set_directories(const QStringList &dirs, const QList<QStringList> &files)
+{
+    beginResetModel();
+    _dirs.clear();
+    _dir_ids.clear();
+    _shown_dirs.clear();
+    _icons.clear();
+    for (int i = 0; i < dirs.size(); ++i)
+    {
+        Directory dir;
+        dir.name = dirs[i];
+        dir.files = files[i];
+        qSort(dir.files);
+        dir.rows.resize(dir.files.size());
+        for (int j = 0; j < dir.rows.size(); ++j)
+            dir.rows[j] = j;
+
+        _dir_ids.insert(dir.name, _dirs.size());
+        _dirs.append(dir);
+        if (!dir.rows.isEmpty())
+            _shown_dirs.insert(lower_bound_i(dir.name), _dirs.size() - 1);
+    }
+    endResetModel();
+}
+
+void ImageTreeModel::set_files(const QString &dir, const QStringList &files)
+{
+    QStringList sorted = files;
+    qSort(sorted);
+    QVector<int> rows(sorted.size());
+    for (int i = 0; i < rows.size(); ++i)
+        rows[i] = i;
+
+    int id = _dir_ids.value(dir, -1);
+    if (id < 0)
+    {
+        if (sorted.isEmpty())
+            return;
+        Directory entry;
+        entry.name = dir;
+        id = _dirs.size();
+        _dir_ids.insert(dir, id);
+        _dirs.append(entry);
+    }
+    update_directory_i(id, sorted, rows);
+}
+
+void ImageTreeModel::set_visible(int dir, const QVector<bool> &visible)
+{
+    QVector<int> rows;
+    for (int i = 0; i < visible.size(); ++i)
+    {
+        if (visible[i])
+            rows.append(i);
+    }
+    update_directory_i(dir, _dirs[dir].files, rows);
+}
+
+int ImageTreeModel::directory_count() const
+{
+    return _dirs.size();
+}
+
+QString ImageTreeModel::directory_name(int dir) const
+{
+    return _dirs[dir].name;
+}
+
+QStringList ImageTreeModel::files(int dir) const
+{
+    return _dirs[dir].files;
+}
+
+QStringList ImageTreeModel::images() const
+{
+    QStringList images;
+    for (int i = 0; i < _dirs.size(); ++i)
+    {
+        for (int j = 0; j < _dirs[i].files.size(); ++j)
+            images << _dirs[i].name + "/" + _dirs[i].files[j];
+    }
+    return images;
+}
+
+bool ImageTreeModel::is_image(const QModelIndex &index) const
+{
+    return index.isValid() && index.internalId() != 0;
+}
+
+QString ImageTreeModel::directory(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return "";
+    if (index.internalId() == 0)
+        return _dirs[_shown_dirs[index.row()]].name;
+    return _dirs[index.internalId() - 1].name;
+}
+
+QString ImageTreeModel::file(const QModelIndex &index) const
+{
+    if (!is_image(index))
+        return "";
+    const Directory &dir = _dirs[index.internalId() - 1];
+    return dir.files[dir.rows[index.row()]];
+}
+
+QModelIndex ImageTreeModel::directory_index(const QString &dir) const
+{
+    int row = directory_row_i(_dir_ids.value(dir, -1));
+    if (row < 0)
+        return QModelIndex();
+    return createIndex(row, 0, quint32(0));
+}
+
+QModelIndex ImageTreeModel::step(const QModelIndex &index, int delta)
+{
+    if (!index.isValid())
+        return QModelIndex();
+
+    // a directory entry counts as the position right before its first image
+    int row;
+    int r;
+    if (index.internalId() == 0)
+    {
+        row = index.row();
+        r = delta > 0 ? delta - 1 : delta;
+    }
+    else
+    {
+        row = directory_row_i(index.internalId() - 1);
+        r = index.row() + delta;
+    }
+
+    // plain index arithmetic .. the hidden images are not in the rows
+    while (r < 0 || r >= _dirs[_shown_dirs[row]].rows.size())
+    {
+        if (r < 0)
+        {
+            if (--row < 0)
+                return QModelIndex();
+            r += _dirs[_shown_dirs[row]].rows.size();
+        }
+        else
+        {
+            r -= _dirs[_shown_dirs[row]].rows.size();
+            if (++row >= _shown_dirs.size())
+                return QModelIndex();
+        }
+    }
+
+    int id = _shown_dirs[row];
+    if (r >= _dirs[id].fetched)
+        fetch_i(id, qMax(r + 1 - _dirs[id].fetched, IMAGE_TREE_FETCH_SIZE));
+    return createIndex(r, 0, quint32(id + 1));
+}
+
+void ImageTreeModel::set_icon(const QModelIndex &index, const QIcon &icon)
+{
+    if (!is_image(index))
+        return;
+
+    QString image = image_i(_dirs[index.internalId() - 1], index.row());
+    if (icon.isNull())
+        _icons.remove(image);
+    else
+        _icons.insert(image, icon);
+    emit dataChanged(index, index);
+}
+
+bool ImageTreeModel::has_icon(const QModelIndex &index) const
+{
+    return is_image(index) && _icons.contains(image_i(_dirs[index.internalId() - 1], index.row()));
+}
+
+QModelIndex ImageTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (row < 0 || column != 0)
+        return QModelIndex();
+
+    if (!parent.isValid())
+    {
+        if (row >= _shown_dirs.size())
+            return QModelIndex();
+        return createIndex(row, 0, quint32(0));
+    }
+
+    if (parent.internalId() != 0)
+        return QModelIndex();
+    int id = _shown_dirs[parent.row()];
+    if (row >= _dirs[id].fetched)
+        return QModelIndex();
+    return createIndex(row, 0, quint32(id + 1));
+}
+
+QModelIndex ImageTreeModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid() || child.internalId() == 0)
+        return QModelIndex();
+    return createIndex(directory_row_i(child.internalId() - 1), 0, quint32(0));
+}
+
+int ImageTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid())
+        return _shown_dirs.size();
+    if (parent.internalId() != 0)
+        return 0;
+    return _dirs[_shown_dirs[parent.row()]].fetched;
+}
+
+int ImageTreeModel::columnCount(const QModelIndex &) const
+{
+    return 1;
+}
+
+bool ImageTreeModel::hasChildren(const QModelIndex &parent) const
+{
+    // the images that have not been fetched yet count as well
+    if (!parent.isValid())
+        return !_shown_dirs.isEmpty();
+    if (parent.internalId() != 0)
+        return false;
+    return !_dirs[_shown_dirs[parent.row()]].rows.isEmpty();
+}
+
+QVariant ImageTreeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    if (role == Qt::DisplayRole)
+    {
+        if (index.internalId() == 0)
+            return _dirs[_shown_dirs[index.row()]].name;
+        return file(index);
+    }
+    if (role == Qt::DecorationRole && index.internalId() != 0)
+    {
+        QString image = image_i(_dirs[index.internalId() - 1], index.row());
+        if (_icons.contains(image))
+            return _icons.value(image);
+    }
+    return QVariant();
+}
+
+QVariant ImageTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (section == 0 && orientation == Qt::Horizontal && role == Qt::DisplayRole)
+        return QString::fromUtf8("\xe5\x9b\xbe\xe5\x83\x8f\xe5\x88\x97\xe8\xa1\xa8");
+    return QVariant();
+}
+
+bool ImageTreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (!parent.isValid() || parent.internalId() != 0)
+        return false;
+    const Directory &dir = _dirs[_shown_dirs[parent.row()]];
+    return dir.fetched < dir.rows.size();
+}
+
+void ImageTreeModel::fetchMore(const QModelIndex &parent)
+{
+    if (!parent.isValid() || parent.internalId() != 0)
+        return;
+    fetch_i(_shown_dirs[parent.row()], IMAGE_TREE_FETCH_SIZE);
+}
+
+int ImageTreeModel::lower_bound_i(const QString &name) const
+{
+    // the position of name within the (sorted) shown directories
+    int begin = 0;
+    int end = _shown_dirs.size();
+    while (begin < end)
+    {
+        int middle = (begin + end) / 2;
+        if (_dirs[_shown_dirs[middle]].name < name)
+            begin = middle + 1;
+        else
+            end = middle;
+    }
+    return begin;
+}
+
+int ImageTreeModel::directory_row_i(int dir) const
+{
+    if (dir < 0)
+        return -1;
+    int row = lower_bound_i(_dirs[dir].name);
+    if (row < _shown_dirs.size() && _shown_dirs[row] == dir)
+        return row;
+    return -1;
+}
+
+QString ImageTreeModel::image_i(const Directory &dir, int row) const
+{
+    return dir.name + "/" + dir.files[dir.rows[row]];
+}
+
+void ImageTreeModel::update_directory_i(int id, const QStringList &files, const QVector<int> &rows)
+{
+    Directory &dir = _dirs[id];
+    int row = directory_row_i(id);
+    int fetched = dir.fetched;
+
+    // the directory entry comes or goes as a whole
+    if (row >= 0 && rows.isEmpty())
+    {
+        beginRemoveRows(QModelIndex(), row, row);
+        _shown_dirs.remove(row);
+        endRemoveRows();
+    }
+    if (row < 0 || rows.isEmpty())
+    {
+        for (int r = 0; r < dir.fetched; ++r)
+            _icons.remove(image_i(dir, r));
+        dir.files = files;
+        dir.rows = rows;
+        dir.fetched = 0;
+        if (row < 0 && !rows.isEmpty())
+        {
+            row = lower_bound_i(dir.name);
+            beginInsertRows(QModelIndex(), row, row);
+            _shown_dirs.insert(row, id);
+            endInsertRows();
+        }
+        return;
+    }
+
+    // otherwise only the rows the view knows of are changed one by one ..
+    // the current/selected entries stay where they are. first the ones that
+    // are gone, both lists are sorted so one walk finds them
+    QModelIndex parent = createIndex(row, 0, quint32(0));
+    QVector<bool> gone(dir.fetched);
+    for (int r = 0, i = 0; r < dir.fetched; ++r)
+    {
+        const QString &name = dir.files[dir.rows[r]];
+        while (i < rows.size() && files[rows[i]] < name)
+            ++i;
+        gone[r] = i >= rows.size() || files[rows[i]] != name;
+    }
+    for (int r = dir.fetched - 1; r >= 0; --r)
+    {
+        if (!gone[r])
+            continue;
+        int last = r;
+        while (r > 0 && gone[r - 1])
+            --r;
+        beginRemoveRows(parent, r, last);
+        for (int k = r; k <= last; ++k)
+            _icons.remove(image_i(dir, k));
+        dir.rows.remove(r, last - r + 1);
+        dir.fetched -= last - r + 1;
+        endRemoveRows();
+    }
+
+    // the remaining ones only get their new file indexes
+    QVector<int> at(dir.fetched);
+    for (int r = 0, i = 0; r < dir.fetched; ++r)
+    {
+        const QString &name = dir.files[dir.rows[r]];
+        while (files[rows[i]] != name)
+            ++i;
+        at[r] = i;
+    }
+    dir.files = files;
+    dir.rows.resize(dir.fetched);
+    for (int r = 0; r < at.size(); ++r)
+        dir.rows[r] = rows[at[r]];
+
+    // new images in between are inserted
+    int next = 0;
+    int inserted = 0;
+    for (int r = 0; r < at.size(); ++r)
+    {
+        int count = at[r] - next;
+        if (count > 0)
+        {
+            int first = r + inserted;
+            beginInsertRows(parent, first, first + count - 1);
+            dir.rows.insert(first, count, 0);
+            for (int k = 0; k < count; ++k)
+                dir.rows[first + k] = rows[next + k];
+            dir.fetched += count;
+            endInsertRows();
+            inserted += count;
+        }
+        next = at[r] + 1;
+    }
+
+    // the ones after the last known row are fetched on demand .. unless the
+    // view knew of some before, then it gets a first batch again
+    for (int i = next; i < rows.size(); ++i)
+        dir.rows.append(rows[i]);
+    if (fetched > 0 && dir.fetched < IMAGE_TREE_FETCH_SIZE)
+        fetch_i(id, IMAGE_TREE_FETCH_SIZE - dir.fetched);
+}
+
+void ImageTreeModel::fetch_i(int id, int count)
+{
+    Directory &dir = _dirs[id];
+    count = qMin(count, dir.rows.size() - dir.fetched);
+    int row = directory_row_i(id);
+    if (count <= 0 || row < 0)
+        return;
+
+    beginInsertRows(createIndex(row, 0, quint32(0)), dir.fetched, dir.fetched + count - 1);
+    dir.fetched += count;
+    endInsertRows();
+}
@@ -0,0 +1,108 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef ImageTreeModel_H
+#define ImageTreeModel_H
+
+#include <QAbstractItemModel>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+#include <QIcon>
+
+// number of image entries that are handed to the view at once
+#define IMAGE_TREE_FETCH_SIZE 500
+
+
+// the images of the opened directory as a two level tree .. directories on
+// top, their images below. the file names are stored sorted per directory,
+// the view only gets to see as many entries as it asked for (fetchMore) and
+// the images hidden by the filter are not part of the model at all
+class ImageTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    ImageTreeModel(QObject *parent = 0);
+
+    // replaces everything .. files[i] are the images of dirs[i]
+    void set_directories(const QStringList &dirs, const QList<QStringList> &files);
+    // replaces the images of one directory .. an unknown directory is added,
+    // one without images vanishes from the view
+    void set_files(const QString &dir, const QStringList &files);
+    // visible[i] tells whether files(dir)[i] is shown
+    void set_visible(int dir, const QVector<bool> &visible);
+
+    int directory_count() const;
+    QString directory_name(int dir) const;
+    // the sorted images of a directory, the hidden ones included
+    QStringList files(int dir) const;
+    // all images as "<dir>/<file>"
+    QStringList images() const;
+
+    bool is_image(const QModelIndex &index) const;
+    QString directory(const QModelIndex &index) const;
+    QString file(const QModelIndex &index) const;
+    QModelIndex directory_index(const QString &dir) const;
+    // the image delta entries below/above index .. crosses directory
+    // boundaries and fetches as needed, invalid beyond either end
+    QModelIndex step(const QModelIndex &index, int delta);
+
+    void set_icon(const QModelIndex &index, const QIcon &icon);
+    bool has_icon(const QModelIndex &index) const;
+
+    virtual QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+    virtual QModelIndex parent(const QModelIndex &child) const;
+    virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    virtual int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    virtual bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+    virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    virtual bool canFetchMore(const QModelIndex &parent) const;
+    virtual void fetchMore(const QModelIndex &parent);
+
+private:
+    struct Directory
+    {
+        QString name;
+        QStringList files;  // sorted
+        QVector<int> rows;  // the shown images, indexes into files
+        int fetched;        // number of rows the view knows of
+        Directory() : fetched(0) {}
+    };
+
+    int lower_bound_i(const QString &name) const;
+    int directory_row_i(int dir) const;
+    QString image_i(const Directory &dir, int row) const;
+    void update_directory_i(int dir, const QStringList &files, const QVector<int> &rows);
+    void fetch_i(int dir, int count);
+
+    // directories are never taken out of _dirs .. the position is the
+    // internal id of their image indexes
+    QVector<Directory> _dirs;
+    QHash<QString, int> _dir_ids;
+    // the directories with shown images, sorted by name
+    QVector<int> _shown_dirs;
+    QHash<QString, QIcon> _icons;
+};
+
+#endif // ImageTreeModel_H
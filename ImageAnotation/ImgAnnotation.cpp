@@ -22,9 +22,366 @@
 #include "ImgAnnotation.h"
 #include <QStringList>
 #include <QFile>
-#include <QRegExp>
-#include <QTextStream>
+#include <QByteArray>
+#include <QDataStream>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QMutexLocker>
+#include <QVarLengthArray>
+#include <QtAlgorithms>
 #include <QtDebug>
+#include <qmath.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "defines.h"
+#include "AtomicFile.h"
+
+#define IA_WRITE_BUFFER_SIZE (1 << 20)
+#define IA_SNAPSHOT_MAGIC 0x49414e53
+#define IA_SNAPSHOT_VERSION 4
+
+// the string pool is a table of blocks .. interned strings never move,
+// which lets readers go without a lock
+#define IA_POOL_BLOCK_BITS 10
+#define IA_POOL_BLOCK_SIZE (1 << IA_POOL_BLOCK_BITS)
+#define IA_POOL_INITIAL_BLOCKS 64
+
+namespace
+{
+    // helpers for parsing annotation files directly on their raw bytes
+
+    inline bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    // strip white spaces from both ends of [begin, end)
+    inline void trimToken(const char *&begin, const char *&end)
+    {
+        while (begin < end && isBlank(*begin))
+            ++begin;
+        while (end > begin && isBlank(*(end - 1)))
+            --end;
+    }
+
+    // case insensitive comparison of [begin, end) with the lower case key
+    inline bool keyEquals(const char *begin, const char *end, const char *key)
+    {
+        for (; begin < end && *key; ++begin, ++key) {
+            char c = *begin;
+            if (c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+            if (c != *key)
+                return false;
+        }
+        return begin == end && *key == 0;
+    }
+
+    // parse the next number in [p, end) .. leading white spaces and commas
+    // are skipped and p is moved behind the number
+    bool parseNumber(const char *&p, const char *end, double &value)
+    {
+        static const double powersOf10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        while (p < end && (isBlank(*p) || *p == ','))
+            ++p;
+        const char *start = p;
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = (*p == '-');
+            ++p;
+        }
+
+        // collect up to 18 significant digits, the rest only shifts the exponent
+        quint64 mantissa = 0;
+        int exponent = 0;
+        int digits = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+            if (mantissa < Q_UINT64_C(100000000000000000))
+                mantissa = 10 * mantissa + (*p - '0');
+            else
+                exponent++;
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+                if (mantissa < Q_UINT64_C(100000000000000000)) {
+                    mantissa = 10 * mantissa + (*p - '0');
+                    exponent--;
+                }
+            }
+        }
+        if (digits == 0) {
+            p = start;
+            return false;
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char *expStart = p++;
+            bool expNegative = false;
+            if (p < end && (*p == '-' || *p == '+')) {
+                expNegative = (*p == '-');
+                ++p;
+            }
+            int exp = 0;
+            const char *expDigits = p;
+            for (; p < end && *p >= '0' && *p <= '9'; ++p)
+                exp = MIN(10 * exp + (*p - '0'), 9999);
+            if (p == expDigits)
+                p = expStart;
+            else
+                exponent += expNegative ? -exp : exp;
+        }
+
+        double result = double(mantissa);
+        if (exponent < 0)
+            result /= (-exponent <= 22) ? powersOf10[-exponent] : pow(10.0, -exponent);
+        else if (exponent > 0)
+            result *= (exponent <= 22) ? powersOf10[exponent] : pow(10.0, exponent);
+        value = negative ? -result : result;
+        return true;
+    }
+
+    // object types and tags repeat over and over in a file .. intern each
+    // distinct value only once per file. the lookup wraps the raw range
+    // without copying it, only new values are copied into the hash
+    class IAStringCache
+    {
+    public:
+        int get(const char *begin, const char *end)
+        {
+            int length = int(end - begin);
+            QHash<QByteArray, int>::const_iterator i = ids.constFind(QByteArray::fromRawData(begin, length));
+            if (i != ids.constEnd())
+                return i.value();
+
+            int id = IAStringPool::intern(QString::fromLocal8Bit(begin, length));
+            ids.insert(QByteArray(begin, length), id);
+            return id;
+        }
+
+    private:
+        QHash<QByteArray, int> ids;
+    };
+
+    // buffered writer for annotation files .. it collects the output in a
+    // large chunk of memory and formats numbers without going through
+    // QTextStream/QLocale
+    class IAWriter
+    {
+    public:
+        IAWriter(QIODevice *device)
+            : device(device), size(0), failed(false)
+        {
+            buffer = new char[IA_WRITE_BUFFER_SIZE];
+        }
+
+        ~IAWriter()
+        {
+            flush();
+            delete[] buffer;
+        }
+
+        IAWriter &operator<<(const char *str)
+        {
+            append(str, int(strlen(str)));
+            return *this;
+        }
+
+        IAWriter &operator<<(const QByteArray &str)
+        {
+            append(str.constData(), str.size());
+            return *this;
+        }
+
+        IAWriter &operator<<(double value)
+        {
+            char str[32];
+            append(str, formatNumber(value, str));
+            return *this;
+        }
+
+        void flush()
+        {
+            if (size > 0)
+                write(buffer, size);
+            size = 0;
+        }
+
+        // false once any write to the device failed
+        bool ok() const
+        {
+            return !failed;
+        }
+
+    private:
+        void append(const char *str, int length)
+        {
+            if (size + length > IA_WRITE_BUFFER_SIZE) {
+                flush();
+                if (length > IA_WRITE_BUFFER_SIZE) {
+                    write(str, length);
+                    return;
+                }
+            }
+            memcpy(buffer + size, str, length);
+            size += length;
+        }
+
+        void write(const char *data, int length)
+        {
+            if (!failed && device->write(data, length) != length)
+                failed = true;
+        }
+
+        // same output as QTextStream's default (smart notation, precision 6)
+        // with a fast path for integral values, e.g., pixel coordinates
+        static int formatNumber(double value, char *str)
+        {
+            if (value == floor(value) && fabs(value) < 1e6) {
+                char digits[16];
+                int nDigits = 0;
+                qint64 integer = qint64(fabs(value));
+                do {
+                    digits[nDigits++] = char('0' + integer % 10);
+                    integer /= 10;
+                } while (integer > 0);
+
+                int length = 0;
+                if (value < 0)
+                    str[length++] = '-';
+                while (nDigits > 0)
+                    str[length++] = digits[--nDigits];
+                str[length] = 0;
+                return length;
+            }
+
+            return qsnprintf(str, 32, "%g", value);
+        }
+
+    private:
+        QIODevice *device;
+        char *buffer;
+        int size;
+        bool failed;
+    };
+
+    // the counterpart to IAStringCache .. encode each distinct object type
+    // and tag only once when writing
+    class IAByteCache
+    {
+    public:
+        const QByteArray &get(int id)
+        {
+            if (id >= raw.size())
+                raw.resize(id + 1);
+            if (raw[id].isNull())
+                raw[id] = IAStringPool::string(id).toLocal8Bit();
+            return raw[id];
+        }
+
+    private:
+        QVector<QByteArray> raw;
+    };
+
+    // the shared string pool .. id 0 is always the type of new objects.
+    // new strings are written to their slot before the count is raised, the
+    // slots of existing ids are never touched again
+    class IAStringPoolData
+    {
+    public:
+        IAStringPoolData()
+        {
+            capacity = IA_POOL_INITIAL_BLOCKS;
+            QString **initial = new QString *[capacity];
+            memset(initial, 0, capacity * sizeof(QString *));
+            blocks = initial;
+            append(QString(NEW_OBJ_TYPE));
+        }
+
+        int append(const QString &str)
+        {
+            int id = count;
+            int block = id >> IA_POOL_BLOCK_BITS;
+            if (block >= capacity) {
+                // the table is grown by a copy .. readers might still look
+                // at the old one, so it is kept (the blocks are shared)
+                QString **grown = new QString *[2 * capacity];
+                memcpy(grown, (QString **)blocks, capacity * sizeof(QString *));
+                memset(grown + capacity, 0, capacity * sizeof(QString *));
+                retired << (QString **)blocks;
+                blocks.fetchAndStoreRelease(grown);
+                capacity *= 2;
+            }
+            QString **table = blocks;
+            if (table[block] == NULL)
+                table[block] = new QString[IA_POOL_BLOCK_SIZE];
+            table[block][id & (IA_POOL_BLOCK_SIZE - 1)] = str;
+            ids.insert(str, id);
+            count.fetchAndStoreRelease(id + 1);
+            return id;
+        }
+
+    public:
+        // guards interning only
+        QMutex mutex;
+        QHash<QString, int> ids;
+        QAtomicPointer<QString *> blocks;
+        int capacity;
+        QVector<QString **> retired;
+        QAtomicInt count;
+    };
+
+    IAStringPoolData stringPool;
+
+    // serialized sizes of the snapshot elements (at least) .. the counts
+    // in a snapshot are checked against the bytes left in the file before
+    // anything is allocated for them
+    const qint64 IA_SNAPSHOT_STRING_BYTES = 4;
+    const qint64 IA_SNAPSHOT_OBJ_BYTES = 4 * 8 + 2 * 8 + 4 * 4;
+    const qint64 IA_SNAPSHOT_TAG_BYTES = 4;
+    const qint64 IA_SNAPSHOT_POINT_BYTES = 2 * 8;
+
+    bool readCount(QDataStream &in, quint32 &count, qint64 elementBytes)
+    {
+        in >> count;
+        return in.status() == QDataStream::Ok && qint64(count) * elementBytes <= in.device()->bytesAvailable();
+    }
+
+    // same layout as QDataStream's operator>> for QVector/QList
+    template <typename T>
+    bool readVector(QDataStream &in, QVector<T> &v, qint64 elementBytes)
+    {
+        quint32 count;
+        if (!readCount(in, count, elementBytes))
+            return false;
+        v.resize(count);
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++)
+            in >> v[i];
+        return in.status() == QDataStream::Ok;
+    }
+
+    bool readStrings(QDataStream &in, QStringList &strings)
+    {
+        quint32 count;
+        if (!readCount(in, count, IA_SNAPSHOT_STRING_BYTES))
+            return false;
+        strings.reserve(count);
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+            QString str;
+            in >> str;
+            strings << str;
+        }
+        return in.status() == QDataStream::Ok;
+    }
+}
+
 
 
 // ========== ImgAnnotation ==========
@@ -37,145 +394,210 @@ void ImgAnnotation::loadFromFile(const QString &filepath)
 {
     // try to open the file
     QFile file(filepath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    if (!file.open(QIODevice::ReadOnly))
         return;
 
     // clear the current content
     dirs.clear();
 
+    // map the file into memory .. if that fails (e.g., for some network shares)
+    // we fall back to reading it in one go
+    QByteArray buffer;
+    const char *data = NULL;
+    qint64 size = file.size();
+    if (size > 0)
+        data = reinterpret_cast<const char *>(file.map(0, size));
+    const bool mapped = (data != NULL);
+    if (!mapped) {
+        buffer = file.readAll();
+        data = buffer.constData();
+        size = buffer.size();
+    }
+    const char *end = data + size;
+
     // loop over all lines
     IAFile *currentFile = NULL;
-    IAObj *currentObj = NULL;
+    int currentObj = -1;
     IAFile emptyFile;
     IAObj emptyObj;
-
-    QTextStream in(&file);
-    while (!in.atEnd()) {
-        QString line = in.readLine();
-        line = line.trimmed();
+    IAStringCache typeCache;
+    IAStringCache tagCache;
+    QVarLengthArray<int, 32> tagIds;
+    QVarLengthArray<QPointF, 64> fixPoints;
+
+    const char *next = data;
+    while (next < end) {
+        // get the next line, trimmed
+        const char *begin = next;
+        const char *lineEnd = static_cast<const char *>(memchr(begin, '\n', end - begin));
+        if (lineEnd == NULL)
+            lineEnd = end;
+        next = lineEnd + 1;
+        trimToken(begin, lineEnd);
 
         // ignore empty lines and comment lines
-        if (line.isEmpty() || line.startsWith("#"))
+        if (begin == lineEnd || *begin == '#')
             continue;
 
         // split the line in its key and value (up to ':' and the value)
-        QString key = line.section(':', 0, 0).trimmed().toLower();
-        QString value = line.section(':', 1, -1).trimmed();
+        const char *keyEnd = static_cast<const char *>(memchr(begin, ':', lineEnd - begin));
+        const char *value = lineEnd;
+        if (keyEnd == NULL)
+            keyEnd = lineEnd;
+        else
+            value = keyEnd + 1;
+        const char *valueEnd = lineEnd;
+        trimToken(begin, keyEnd);
+        trimToken(value, valueEnd);
 
         //
         // decide what to do based on the key value
         //
 
-        if (key == "file") {
+        if (keyEquals(begin, keyEnd, "file")) {
             // we have a new file given .. parse the pathname
-            QString filename = value.section('/', -1);
-            QString dir = value.section('/', 0, -2);
-
-            // add a new empty file .. if it doesn't exist already
-            if (!(dirs.contains(dir) && dirs[dir].files.contains(filename))) {
-                dirs[dir].files[filename] = emptyFile;
-            }
+            const char *slash = valueEnd;
+            while (slash > value && *(slash - 1) != '/')
+                --slash;
+            QString filename = QString::fromLocal8Bit(slash, int(valueEnd - slash));
+            QString dir = slash > value ? QString::fromLocal8Bit(value, int(slash - 1 - value)) : QString();
 
+            // add a new empty file .. if it doesn't exist already and
             // update currentFile and currentObj (to zero, since we added a new file)
-            currentFile = &(dirs[dir].files[filename]);
-            currentObj = NULL;
+            IADir &currentDir = dirs[dir];
+            QHash<QString, IAFile>::iterator iFile = currentDir.files.find(filename);
+            if (iFile == currentDir.files.end())
+                iFile = currentDir.files.insert(filename, emptyFile);
+            currentFile = &(*iFile);
+            currentObj = -1;
         }
-        else if (key == "object") {
+        else if (keyEquals(begin, keyEnd, "object")) {
             // we have a new object given
             if (currentFile == NULL)
                 continue;
 
-            // add a new empty object
-            emptyObj.type = value;
-            currentFile->objects << emptyObj;
-
-            // update currentObj
-            currentObj = &(currentFile->objects.last());
+            // add a new empty object and update currentObj
+            emptyObj.type.id = typeCache.get(value, valueEnd);
+            currentObj = currentFile->append(emptyObj);
         }
-        else if (key == "minxymaxxy") {
+        else if (keyEquals(begin, keyEnd, "minxymaxxy")) {
             // we have new coordinates for min/max x/y value
-            if (currentObj == NULL)
+            if (currentObj < 0)
                 continue;
 
             // set the min/max values for x/y
-            currentObj->box.setLeft(value.section(',', 0, 0).trimmed().toFloat());
-            currentObj->box.setTop(value.section(',', 1, 1).trimmed().toFloat());
-            currentObj->box.setRight(value.section(',', 2, 2).trimmed().toFloat());
-            currentObj->box.setBottom(value.section(',', 3, 3).trimmed().toFloat());
+            double coords[4] = { 0, 0, 0, 0 };
+            for (int i = 0; i < 4 && parseNumber(value, valueEnd, coords[i]); i++)
+                ;
+            QRectF &box = currentFile->objects[currentObj].box;
+            box.setLeft(coords[0]);
+            box.setTop(coords[1]);
+            box.setRight(coords[2]);
+            box.setBottom(coords[3]);
         }
-        else if (key == "tags") {
+        else if (keyEquals(begin, keyEnd, "tags")) {
             // we have tags given
-            if (currentObj == NULL)
+            if (currentObj < 0)
                 continue;
 
-            // clean the taggs and add the given ones to the currentObj
-            currentObj->tags.clear();
-            currentObj->tags << value.split(QRegExp("\\s*,\\s*"), QString::SkipEmptyParts);
+            // replace the tags of the currentObj with the given ones
+            tagIds.clear();
+            while (value < valueEnd) {
+                const char *tag = value;
+                const char *tagEnd = static_cast<const char *>(memchr(tag, ',', valueEnd - tag));
+                if (tagEnd == NULL)
+                    tagEnd = valueEnd;
+                value = tagEnd + 1;
+                trimToken(tag, tagEnd);
+                if (tag != tagEnd)
+                    tagIds.append(tagCache.get(tag, tagEnd));
+            }
+            currentFile->setTagIds(currentObj, tagIds.constData(), tagIds.size());
         }
-        else if (key == "fixpointsxy") {
+        else if (keyEquals(begin, keyEnd, "fixpointsxy")) {
             // we have a list of fix points given
-            if (currentObj == NULL)
+            if (currentObj < 0)
                 continue;
 
-            // split the list and add the points to the fix point list
-            QStringList points = value.split(QRegExp("\\s*,\\s*"), QString::SkipEmptyParts);
-            for (int i = 0; i < points.count() - 1; i += 2) {
-                QPointF newPoint(points[i].trimmed().toFloat(), points[i + 1].trimmed().toFloat());
-                currentObj->fixPoints << newPoint;
-            }
+            // parse the list pairwise and add the points to the fix point list
+            double x, y;
+            fixPoints.clear();
+            while (parseNumber(value, valueEnd, x) && parseNumber(value, valueEnd, y))
+                fixPoints.append(QPointF(x, y));
+            currentFile->appendFixPoints(currentObj, fixPoints.constData(), fixPoints.size());
         }
-        else if (key == "score") {
+        else if (keyEquals(begin, keyEnd, "score")) {
             // we have a score value
-            if (currentObj == NULL)
+            if (currentObj < 0)
                 continue;
 
             // update our score value
-            currentObj->score = value.toDouble();
+            double score = 0.0;
+            parseNumber(value, valueEnd, score);
+            currentFile->objects[currentObj].score = score;
         }
     }
 
+    if (mapped)
+        file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(data)));
+
+    // index all the new objects in one go
+    rebuildIndexes();
+
     // emit a signal that something has changed
     emit filesChanged();
 }
 
-void ImgAnnotation::saveToFile(const QString &filepath)
+bool ImgAnnotation::saveToFile(const QString &filepath)
 {
     // try to open the file
-    QFile file(filepath);
-    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
-        return;
+    // the target is replaced only once the file is complete
+    QFile file(AtomicFile::temp_name(filepath));
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
 
     // loop over all elements in our datastructur and write their data to the file
-    QTextStream out(&file);
-    QList<QString> dirList = getDirs();
-    for (QList<QString>::const_iterator iDir = dirList.constBegin(); iDir != dirList.constEnd(); ++iDir) {
-        QList<QString> fileList = getDirFiles(*iDir);
-        for (QList<QString>::const_iterator iFile = fileList.constBegin(); iFile != fileList.constEnd(); ++iFile) {
-            IAFile *file = getFile(*iDir, *iFile);
+    IAWriter out(&file);
+    IAByteCache strings;
+    for (QHash<QString, IADir>::const_iterator iDir = dirs.constBegin(); iDir != dirs.constEnd(); ++iDir) {
+        QByteArray dirName = iDir.key().toLocal8Bit();
+        for (QHash<QString, IAFile>::const_iterator iFile = (*iDir).files.constBegin(); iFile != (*iDir).files.constEnd(); ++iFile) {
+            const IAFile &iaFile = *iFile;
             out << "########## NEW FILE ##########\n";
-            out << "file: " << *iDir << "/" << *iFile << "\n\n";
-            for (QList<IAObj>::const_iterator iObj = file->objects.constBegin(); iObj != file->objects.constEnd(); ++iObj) {
+            out << "file: " << dirName << "/" << iFile.key().toLocal8Bit() << "\n\n";
+            for (int iObj = 0; iObj < iaFile.objects.count(); iObj++) {
+                const IAObj &obj = iaFile.objects[iObj];
+
                 // output the object type
-                out << "object: " << (*iObj).type << "\n";
+                out << "object: " << strings.get(obj.type.id) << "\n";
 
                 // output the bounding box
-                if (!(*iObj).box.isEmpty())
+                if (!obj.box.isEmpty())
                     out << "minXYMaxXY: "
-                    << (*iObj).box.left() << ", "
-                    << (*iObj).box.top() << ", "
-                    << (*iObj).box.right() << ", "
-                    << (*iObj).box.bottom() << "\n";
+                    << obj.box.left() << ", "
+                    << obj.box.top() << ", "
+                    << obj.box.right() << ", "
+                    << obj.box.bottom() << "\n";
 
                 // output the tags
-                if (!(*iObj).tags.isEmpty())
-                    out << "tags: " << (*iObj).tags.join(", ") << "\n";
+                if (!obj.tags.isEmpty()) {
+                    const int *tagIds = iaFile.tagIds(iObj);
+                    out << "tags: ";
+                    for (int iTag = 0; iTag < obj.tags.count(); iTag++) {
+                        if (iTag > 0)
+                            out << ", ";
+                        out << strings.get(tagIds[iTag]);
+                    }
+                    out << "\n";
+                }
 
                 // output the fix points
-                if (!(*iObj).fixPoints.isEmpty()) {
+                if (!obj.fixPoints.isEmpty()) {
+                    const QPointF *fixPoints = iaFile.fixPointData(iObj);
                     out << "fixPointsXY: ";
-                    for (int iPoint = 0; iPoint < (*iObj).fixPoints.count(); iPoint++) {
-                        out << (*iObj).fixPoints[iPoint].x() << ", " << (*iObj).fixPoints[iPoint].y();
-                        if (iPoint < (*iObj).fixPoints.count() - 1)
+                    for (int iPoint = 0; iPoint < obj.fixPoints.count(); iPoint++) {
+                        out << fixPoints[iPoint].x() << ", " << fixPoints[iPoint].y();
+                        if (iPoint < obj.fixPoints.count() - 1)
                             out << ", ";
                         else
                             out << "\n";
@@ -183,14 +605,181 @@ void ImgAnnotation::saveToFile(const QString &filepath)
                 }
 
                 // output the score
-                if ((*iObj).score != 0)
-                    out << "score: " << (*iObj).score << "\n";
+                if (obj.score != 0)
+                    out << "score: " << obj.score << "\n";
 
                 // a additional empty line at the end of an object
                 out << "\n";
             }
         }
     }
+    out.flush();
+
+    if (!out.ok()) {
+        qWarning() << "ImgAnnotation: could not write" << filepath;
+        file.close();
+        file.remove();
+        return false;
+    }
+    return AtomicFile::commit(file, filepath);
+}
+
+bool ImgAnnotation::saveSnapshot(const QString &filepath) const
+{
+    // try to open the file
+    // the target is replaced only once the file is complete
+    QFile file(AtomicFile::temp_name(filepath));
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    // write the complete datastructure in one go .. types and tags as ids,
+    // preceded by the strings the ids refer to
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_7);
+    out << quint32(IA_SNAPSHOT_MAGIC) << quint32(IA_SNAPSHOT_VERSION);
+
+    QStringList strings;
+    for (int i = 0; i < IAStringPool::count(); i++)
+        strings << IAStringPool::string(i);
+    out << strings;
+
+    out << quint32(dirs.size());
+    for (QHash<QString, IADir>::const_iterator iDir = dirs.constBegin(); iDir != dirs.constEnd(); ++iDir) {
+        out << iDir.key() << quint32((*iDir).files.size());
+        for (QHash<QString, IAFile>::const_iterator iFile = (*iDir).files.constBegin(); iFile != (*iDir).files.constEnd(); ++iFile) {
+            // the objects with the sizes of their ranges, followed by the
+            // tags and the fix points of all objects in a row
+            const IAFile &iaFile = *iFile;
+            const QVector<IAObj> &objects = iaFile.objects;
+            out << iFile.key() << quint32(objects.count());
+            quint32 nTags = 0, nFixPoints = 0;
+            for (int i = 0; i < objects.count(); i++) {
+                const IAObj &obj = objects[i];
+                out << obj.box << obj.score << obj.comboScore << quint32(obj.id) << qint32(obj.type.id);
+                out << quint32(obj.tags.count()) << quint32(obj.fixPoints.count());
+                nTags += obj.tags.count();
+                nFixPoints += obj.fixPoints.count();
+            }
+            out << nTags;
+            for (int i = 0; i < objects.count(); i++) {
+                const int *tagIds = iaFile.tagIds(i);
+                for (int j = 0; j < objects[i].tags.count(); j++)
+                    out << qint32(tagIds[j]);
+            }
+            out << nFixPoints;
+            for (int i = 0; i < objects.count(); i++) {
+                const QPointF *fixPoints = iaFile.fixPointData(i);
+                for (int j = 0; j < objects[i].fixPoints.count(); j++)
+                    out << fixPoints[j];
+            }
+        }
+    }
+
+    if (out.status() != QDataStream::Ok) {
+        qWarning() << "ImgAnnotation: could not write snapshot" << filepath;
+        file.close();
+        file.remove();
+        return false;
+    }
+    return AtomicFile::commit(file, filepath);
+}
+
+bool ImgAnnotation::loadSnapshot(const QString &filepath)
+{
+    // try to open the file
+    QFile file(filepath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_7);
+    quint32 magic, version;
+    in >> magic >> version;
+    if (magic != IA_SNAPSHOT_MAGIC || version != IA_SNAPSHOT_VERSION)
+        return false;
+
+    // the ids in the snapshot refer to its own string table .. map them
+    // onto the ids of our pool
+    QStringList strings;
+    if (!readStrings(in, strings))
+        return false;
+    QVector<int> idMap(strings.size());
+    for (int i = 0; i < strings.size(); i++)
+        idMap[i] = IAStringPool::intern(strings[i]);
+
+    // read everything into a new structure .. the current content is
+    // only replaced if the snapshot could be read completely
+    QHash<QString, IADir> newDirs;
+    quint32 nDirs, nFiles;
+    // a dir is at least its name and its file count, a file its name and
+    // its object count
+    bool valid = readCount(in, nDirs, 2 * 4);
+    for (quint32 iDir = 0; iDir < nDirs && valid && in.status() == QDataStream::Ok; iDir++) {
+        QString dirName;
+        in >> dirName;
+        valid = readCount(in, nFiles, 2 * 4);
+        if (!valid)
+            break;
+        IADir &dir = newDirs[dirName];
+        dir.files.reserve(nFiles);
+        for (quint32 iFile = 0; iFile < nFiles && valid && in.status() == QDataStream::Ok; iFile++) {
+            QString fileName;
+            quint32 nObjs;
+            in >> fileName;
+            valid = readCount(in, nObjs, IA_SNAPSHOT_OBJ_BYTES);
+            if (!valid)
+                break;
+
+            // the ranges follow each other in the arrays of the file
+            IAFile newFile;
+            newFile.objects.resize(nObjs);
+            qint64 nTags = 0, nFixPoints = 0;
+            for (quint32 i = 0; i < nObjs && valid; i++) {
+                IAObj &obj = newFile.objects[i];
+                quint32 id, tagCount, fixPointCount;
+                qint32 typeId;
+                in >> obj.box >> obj.score >> obj.comboScore >> id >> typeId >> tagCount >> fixPointCount;
+                valid = in.status() == QDataStream::Ok && typeId >= 0 && typeId < idMap.size()
+                    && nTags + tagCount <= INT_MAX && nFixPoints + fixPointCount <= INT_MAX;
+                if (!valid)
+                    break;
+
+                obj.id = id;
+                obj.type.id = idMap[typeId];
+                obj.tags.offset = int(nTags);
+                obj.tags.length = tagCount;
+                obj.fixPoints.offset = int(nFixPoints);
+                obj.fixPoints.length = fixPointCount;
+                nTags += tagCount;
+                nFixPoints += fixPointCount;
+            }
+
+            // check the sizes of the arrays and translate the ids
+            valid = valid && readVector(in, newFile.tagArray, IA_SNAPSHOT_TAG_BYTES)
+                && newFile.tagArray.count() == nTags
+                && readVector(in, newFile.fixPointArray, IA_SNAPSHOT_POINT_BYTES)
+                && newFile.fixPointArray.count() == nFixPoints;
+            int *tagIds = newFile.tagArray.data();
+            for (int j = 0; j < newFile.tagArray.count() && valid; j++) {
+                valid = tagIds[j] >= 0 && tagIds[j] < idMap.size();
+                if (valid)
+                    tagIds[j] = idMap[tagIds[j]];
+            }
+            if (!valid)
+                break;
+            dir.files.insert(fileName, newFile);
+        }
+    }
+
+    if (!valid || in.status() != QDataStream::Ok)
+        return false;
+
+    dirs.swap(newDirs);
+    rebuildIndexes();
+
+    // emit a signal that something has changed
+    emit filesChanged();
+    return true;
 }
 
 void ImgAnnotation::addFiles(const QStringList& files)
@@ -202,7 +791,10 @@ void ImgAnnotation::addFiles(const QStringList& files)
         QString filename = files[i].section('/', -1);
         QString path = files[i].section('/', 0, -2);
 
-        dirs[path].files[filename] = emptyFile;
+        IAFile &file = dirs[path].files[filename];
+        indexFile(file, -1);
+        file = emptyFile;
+        registerFile(path, filename, &file);
     }
 
     // emit a signal that something has changed
@@ -216,12 +808,24 @@ void ImgAnnotation::removeFiles(const QStringList& files)
         QString filename = files[i].section('/', -1);
         QString path = files[i].section('/', 0, -2);
 
-        if (filename.isEmpty())
+        if (!dirs.contains(path))
+            continue;
+
+        IADir &dir = dirs[path];
+        if (filename.isEmpty()) {
             // delete the whole directory
+            for (QHash<QString, IAFile>::const_iterator iFile = dir.files.constBegin(); iFile != dir.files.constEnd(); ++iFile) {
+                indexFile(*iFile, -1);
+                registerFile(path, iFile.key(), NULL);
+            }
             dirs.remove(path);
-        else
+        }
+        else if (dir.files.contains(filename)) {
             // remove file
-            dirs[path].files.remove(filename);
+            indexFile(dir.files[filename], -1);
+            registerFile(path, filename, NULL);
+            dir.files.remove(filename);
+        }
     }
 
     // emit a signal that something has changed
@@ -233,149 +837,572 @@ QList<QString> ImgAnnotation::getDirs() const
     return dirs.keys();
 }
 
-QList<QString> ImgAnnotation::getDirFiles(const QString dir) const
+QList<QString> ImgAnnotation::getDirFiles(const QString &dir) const
 {
-    if (!dirs.contains(dir))
+    QHash<QString, IADir>::const_iterator i = dirs.constFind(dir);
+    if (i == dirs.constEnd())
         return QList<QString>();
 
-    return dirs[dir].files.keys();
+    return (*i).files.keys();
+}
+
+IAFileHandle ImgAnnotation::fileHandle(const QString &dir, const QString &file) const
+{
+    QHash<QPair<QString, QString>, int>::const_iterator i = handleIds.constFind(qMakePair(dir, file));
+    if (i == handleIds.constEnd() || handles[i.value()].data == NULL)
+        return IA_INVALID_HANDLE;
+
+    return i.value();
+}
+
+IAFileHandle ImgAnnotation::createFile(const QString &dir, const QString &file)
+{
+    // return the handle of the file .. the file entry is created if necessary
+    IAFileHandle handle = fileHandle(dir, file);
+    if (handle != IA_INVALID_HANDLE)
+        return handle;
+
+    return registerFile(dir, file, &(dirs[dir].files[file]));
+}
+
+QString ImgAnnotation::handleDir(IAFileHandle handle) const
+{
+    if (handle < 0 || handle >= handles.count())
+        return QString();
+
+    return handles[handle].dir;
+}
+
+QString ImgAnnotation::handleFile(IAFileHandle handle) const
+{
+    if (handle < 0 || handle >= handles.count())
+        return QString();
+
+    return handles[handle].file;
 }
 
-QList<IAObj> *ImgAnnotation::getObj(const QString dir, const QString file)
+IAFile *ImgAnnotation::getFile(IAFileHandle handle)
 {
-    if (!dirs.contains(dir) || !dirs[dir].files.contains(file))
+    if (handle < 0 || handle >= handles.count())
         return NULL;
 
-    return &(dirs[dir].files[file].objects);
+    return handles[handle].data;
 }
 
-IAObj *ImgAnnotation::getObj(const QString dir, const QString file, const int objIndex)
+const IAFile *ImgAnnotation::getFile(IAFileHandle handle) const
 {
-    if (!dirs.contains(dir) || !dirs[dir].files.contains(file)
-        || objIndex < 0 || objIndex >= dirs[dir].files[file].objects.count())
+    if (handle < 0 || handle >= handles.count())
         return NULL;
 
-    return &(dirs[dir].files[file].objects[objIndex]);
+    return handles[handle].data;
 }
 
-IAFile *ImgAnnotation::getFile(const QString dir, const QString file)
+QVector<IAObj> *ImgAnnotation::getObj(IAFileHandle handle)
 {
-    if (!dirs.contains(dir) || !dirs[dir].files.contains(file))
+    IAFile *iaFile = getFile(handle);
+    if (iaFile == NULL)
         return NULL;
 
-    return &(dirs[dir].files[file]);
+    return &(iaFile->objects);
 }
 
-QStringList ImgAnnotation::getAllTags() const
+IAObj *ImgAnnotation::getObj(IAFileHandle handle, const int objIndex)
 {
-    QStringList tags;
-    QHash<QString, bool> tagsHash;
+    IAFile *iaFile = getFile(handle);
+    if (iaFile == NULL || objIndex < 0 || objIndex >= iaFile->objects.count())
+        return NULL;
 
-    // go through all objects and collect different tags
-    for (QHash<QString, IADir>::const_iterator iDir = dirs.constBegin(); iDir != dirs.constEnd(); ++iDir) {
-        for (QHash<QString, IAFile>::const_iterator iFile = (*iDir).files.constBegin(); iFile != (*iDir).files.constEnd(); ++iFile) {
-            for (QList<IAObj>::const_iterator iObj = (*iFile).objects.constBegin(); iObj != (*iFile).objects.constEnd(); ++iObj) {
-                for (QStringList::const_iterator iTag = (*iObj).tags.constBegin(); iTag != (*iObj).tags.constEnd(); ++iTag) {
-                    // get the next tag, convert it to lower case, and see wether it exists (via our tag hash map)
-                    QString tagLowerCase = (*iTag).toLower();
-                    if (!tagsHash.contains(tagLowerCase)) {
-                        tagsHash[tagLowerCase] = true;
-                        tags << *iTag;
-                    }
-                }
-            }
-        }
-    }
+    return &(iaFile->objects[objIndex]);
+}
 
-    return tags;
+QVector<IAObj> *ImgAnnotation::getObj(const QString &dir, const QString &file)
+{
+    return getObj(fileHandle(dir, file));
+}
+
+IAObj *ImgAnnotation::getObj(const QString &dir, const QString &file, const int objIndex)
+{
+    return getObj(fileHandle(dir, file), objIndex);
+}
+
+IAFile *ImgAnnotation::getFile(const QString &dir, const QString &file)
+{
+    return getFile(fileHandle(dir, file));
+}
+
+QStringList ImgAnnotation::getAllTags() const
+{
+    return tagIndex.strings();
 }
 
 QStringList ImgAnnotation::getAllObjTypes() const
 {
     QStringList types;
-    QHash<QString, bool> typesHash;
 
     // add the object type for new objects
     QString newType(NEW_OBJ_TYPE);
-    typesHash[newType.toLower()] = true;
     types << newType;
 
-    // go through all objects and collect different tags
-    for (QHash<QString, IADir>::const_iterator iDir = dirs.constBegin(); iDir != dirs.constEnd(); ++iDir) {
-        for (QHash<QString, IAFile>::const_iterator iFile = (*iDir).files.constBegin(); iFile != (*iDir).files.constEnd(); ++iFile) {
-            for (QList<IAObj>::const_iterator iObj = (*iFile).objects.constBegin(); iObj != (*iFile).objects.constEnd(); ++iObj) {
-                // get the next object type, convert it to lower case, and see wether it exists (via our type hash map)
-                QString typeLowerCase = (*iObj).type.toLower();
-                if (!typesHash.contains(typeLowerCase)) {
-                    typesHash[typeLowerCase] = true;
-                    types << (*iObj).type;
-                }
-            }
-        }
+    // add the types of all objects .. except for the one for new objects
+    QStringList objTypes = typeIndex.strings();
+    for (int i = 0; i < objTypes.count(); i++) {
+        if (objTypes[i].compare(newType, Qt::CaseInsensitive) != 0)
+            types << objTypes[i];
     }
 
     return types;
 }
 
-void ImgAnnotation::newObj(const QString dir, const QString file, const QString objType)
+int ImgAnnotation::getTagCount(const QString &tag) const
 {
-    // make sure that a file entry exists
-    if (!dirs.contains(dir) || !dirs[dir].files.contains(file)) {
-        IAFile emptyFile;
-        dirs[dir].files[file] = emptyFile;
-    }
+    return tagIndex.count(tag);
+}
+
+int ImgAnnotation::getObjTypeCount(const QString &type) const
+{
+    return typeIndex.count(type);
+}
 
-    // add a new object to our database
+QHash<QString, int> ImgAnnotation::getObjTypeCounts() const
+{
+    return typeIndex.counts();
+}
+
+void ImgAnnotation::newObj(const QString &dir, const QString &file, const QString &objType)
+{
+    // add a new object to our database .. the file entry is created if necessary
     IAObj emptyObj;
     emptyObj.type = objType;
-    dirs[dir].files[file].objects << emptyObj;
+    newObj(createFile(dir, file), emptyObj);
+}
+
+void ImgAnnotation::newObj(const QString &dir, const QString &file, const IAObj &obj)
+{
+    // add the new object to our database .. the file entry is created if necessary
+    newObj(createFile(dir, file), obj);
+}
+
+void ImgAnnotation::newObj(IAFileHandle handle, const IAObj &newObj, const QStringList &tags, const QList<QPointF> &fixPoints)
+{
+    IAFile *iaFile = getFile(handle);
+    if (iaFile == NULL)
+        return;
+
+    int objIndex = iaFile->append(newObj, tags, fixPoints);
+    indexObj(*iaFile, objIndex, 1);
 
     // send signal that an object has been added
-    emit objectsChanged();
+    emitObjectsChanged(handle, objIndex, objIndex);
 }
 
-void ImgAnnotation::newObj(const QString dir, const QString file, const IAObj &newObj)
+void ImgAnnotation::newObjs(const QString &dir, const QString &file, const QList<IAObj> &newObjs)
 {
-    // make sure that a file entry exists
-    if (!dirs.contains(dir) || !dirs[dir].files.contains(file)) {
-        IAFile emptyFile;
-        dirs[dir].files[file] = emptyFile;
+    if (!newObjs.isEmpty())
+        this->newObjs(createFile(dir, file), newObjs);
+}
+
+void ImgAnnotation::newObjs(IAFileHandle handle, const QList<IAObj> &newObjs)
+{
+    IAFile *iaFile = getFile(handle);
+    if (iaFile == NULL || newObjs.isEmpty())
+        return;
+
+    // make room for all objects at once
+    iaFile->reserve(newObjs.count());
+    int first = iaFile->objects.count();
+    for (int i = 0; i < newObjs.count(); i++) {
+        int objIndex = iaFile->append(newObjs[i]);
+        indexObj(*iaFile, objIndex, 1);
     }
 
-    // add the new object to our database
-    dirs[dir].files[file].objects << newObj;
+    // send one signal for all added objects
+    emitObjectsChanged(handle, first, iaFile->objects.count() - 1);
+}
 
-    // send signal that an object has been added
-    emit objectsChanged();
+void ImgAnnotation::setObjType(const QString &dir, const QString &file, const int objIndex, const QString &type)
+{
+    setObjType(fileHandle(dir, file), objIndex, type);
+}
+
+void ImgAnnotation::setObjType(IAFileHandle handle, const int objIndex, const QString &type)
+{
+    IAObj *obj = getObj(handle, objIndex);
+    if (obj == NULL)
+        return;
+
+    typeIndex.remove(obj->type.id);
+    obj->type = type;
+    typeIndex.add(obj->type.id);
+
+    // send signal that an object has been changed
+    emitObjectsChanged(handle, objIndex, objIndex);
+}
+
+void ImgAnnotation::setObjTags(const QString &dir, const QString &file, const int objIndex, const QStringList &tags)
+{
+    setObjTags(fileHandle(dir, file), objIndex, tags);
 }
 
-void ImgAnnotation::removeObj(const QString dir, const QString file, const QList<int> removeObj)
+void ImgAnnotation::setObjTags(IAFileHandle handle, const int objIndex, const QStringList &tags)
 {
-    if (!dirs.contains(dir) || !dirs[dir].files.contains(file))
+    IAFile *iaFile = getFile(handle);
+    if (iaFile == NULL || objIndex < 0 || objIndex >= iaFile->objects.count())
         return;
 
-    QList<IAObj> *objList = &(dirs[dir].files[file].objects);
+    const IARange &objTags = iaFile->objects[objIndex].tags;
+    for (int i = 0; i < objTags.count(); i++)
+        tagIndex.remove(iaFile->tagIds(objIndex)[i]);
+    iaFile->setTags(objIndex, tags);
+    for (int i = 0; i < objTags.count(); i++)
+        tagIndex.add(iaFile->tagIds(objIndex)[i]);
+
+    // send signal that an object has been changed
+    emitObjectsChanged(handle, objIndex, objIndex);
+}
+
+void ImgAnnotation::setObjBox(const QString &dir, const QString &file, const int objIndex, const QRectF &box)
+{
+    setObjBox(fileHandle(dir, file), objIndex, box);
+}
+
+void ImgAnnotation::setObjBox(IAFileHandle handle, const int objIndex, const QRectF &box)
+{
+    IAFile *iaFile = getFile(handle);
+    if (iaFile == NULL || objIndex < 0 || objIndex >= iaFile->objects.count())
+        return;
+
+    iaFile->objects[objIndex].box = box;
+    iaFile->updateBounds(objIndex);
+
+    // send signal that an object has been changed
+    emitObjectsChanged(handle, objIndex, objIndex);
+}
+
+void ImgAnnotation::removeObj(const QString &dir, const QString &file, const QList<int> removeObj)
+{
+    IAFileHandle handle = fileHandle(dir, file);
+    IAFile *iaFile = getFile(handle);
+    if (iaFile == NULL)
+        return;
+
+    int oldCount = iaFile->objects.count();
+    int first = oldCount;
     int removed = 0;
     for (QList<int>::const_iterator i = removeObj.constBegin(); i != removeObj.constEnd(); ++i) {
         int index = (*i) - removed;
 
         // check wether this object exists
-        if (index < 0 || index >= objList->count())
+        if (index < 0 || index >= iaFile->objects.count())
             continue;
 
-        // remove object from list
-        objList->removeAt(index);
+        // remove object from list and from the indexes
+        indexObj(*iaFile, index, -1);
+        iaFile->remove(index);
+        first = qMin(first, index);
         removed++;
     }
 
-    // send signal that an object has been added
-    emit objectsChanged();
+    // send signal that an object has been removed
+    if (removed > 0)
+        emitObjectsChanged(handle, first, oldCount - 1);
+}
+
+void ImgAnnotation::removeObjs(const QString &dir, const QString &file, const QList<int> &objIndexes)
+{
+    removeObjs(fileHandle(dir, file), objIndexes);
+}
+
+void ImgAnnotation::removeObjs(IAFileHandle handle, const QList<int> &objIndexes)
+{
+    IAFile *iaFile = getFile(handle);
+    if (iaFile == NULL)
+        return;
+
+    // mark the objects to remove .. the indexes refer to the current
+    // numbering, they may come in any order, duplicates and invalid
+    // indexes are ignored
+    int oldCount = iaFile->objects.count();
+    QBitArray marked(oldCount);
+    int first = oldCount;
+    for (QList<int>::const_iterator i = objIndexes.constBegin(); i != objIndexes.constEnd(); ++i) {
+        int index = *i;
+        if (index < 0 || index >= oldCount || marked.testBit(index))
+            continue;
+
+        marked.setBit(index);
+        indexObj(*iaFile, index, -1);
+        first = qMin(first, index);
+    }
+
+    if (first >= oldCount)
+        return;
+
+    // remove all of them in one pass
+    iaFile->remove(marked);
+
+    // send one signal for all removed objects
+    emitObjectsChanged(handle, first, oldCount - 1);
 }
 
 
 void ImgAnnotation::clear()
 {
     dirs.clear();
+    typeIndex.clear();
+    tagIndex.clear();
+
+    // the handles stay reserved for their names, they just point nowhere
+    for (int i = 0; i < handles.count(); i++)
+        handles[i].data = NULL;
+}
+
+void ImgAnnotation::rebuildIndexes()
+{
+    typeIndex.clear();
+    tagIndex.clear();
+    for (int i = 0; i < handles.count(); i++)
+        handles[i].data = NULL;
+
+    // iterating non-const makes sure that dirs is detached, so the file
+    // pointers stored with the handles stay valid
+    for (QHash<QString, IADir>::iterator iDir = dirs.begin(); iDir != dirs.end(); ++iDir) {
+        for (QHash<QString, IAFile>::iterator iFile = (*iDir).files.begin(); iFile != (*iDir).files.end(); ++iFile) {
+            indexFile(*iFile, 1);
+            registerFile(iDir.key(), iFile.key(), &(*iFile));
+        }
+    }
+}
+
+IAFileHandle ImgAnnotation::registerFile(const QString &dir, const QString &file, IAFile *data)
+{
+    // handles are never reused .. a dir/file name keeps its handle for the
+    // lifetime of this object, also if it is removed and added again
+    QPair<QString, QString> key(dir, file);
+    QHash<QPair<QString, QString>, int>::const_iterator i = handleIds.constFind(key);
+    IAFileHandle handle;
+    if (i != handleIds.constEnd()) {
+        handle = i.value();
+    }
+    else {
+        FileRef ref;
+        ref.dir = dir;
+        ref.file = file;
+        handle = handles.count();
+        handles << ref;
+        handleIds.insert(key, handle);
+    }
+
+    handles[handle].data = data;
+    return handle;
+}
+
+void ImgAnnotation::indexFile(const IAFile &file, int sign)
+{
+    // add (sign > 0) or remove (sign < 0) all objects of the file to/from the indexes
+    for (int iObj = 0; iObj < file.objects.count(); iObj++)
+        indexObj(file, iObj, sign);
+}
+
+void ImgAnnotation::indexObj(const IAFile &file, int objIndex, int sign)
+{
+    const IAObj &obj = file.objects[objIndex];
+    const int *tagIds = file.tagIds(objIndex);
+    if (sign > 0) {
+        typeIndex.add(obj.type.id);
+        for (int iTag = 0; iTag < obj.tags.count(); iTag++)
+            tagIndex.add(tagIds[iTag]);
+    }
+    else {
+        typeIndex.remove(obj.type.id);
+        for (int iTag = 0; iTag < obj.tags.count(); iTag++)
+            tagIndex.remove(tagIds[iTag]);
+    }
+}
+
+void ImgAnnotation::emitObjectsChanged(IAFileHandle handle, int first, int last)
+{
+    emit objectsChanged(handles[handle].dir, handles[handle].file, first, last);
+    emit objectsChanged();
+}
+
+
+// ========== IAStringIndex ==========
+
+void IAStringIndex::add(int id, int count)
+{
+    Entry &entry = entries[slot(id)];
+
+    // the first spelling that comes in is the one we report
+    if (entry.count <= 0)
+        entry.spelling = IAStringPool::string(id);
+    entry.count += count;
+}
+
+void IAStringIndex::remove(int id, int count)
+{
+    Entry &entry = entries[slot(id)];
+    entry.count = qMax(entry.count - count, 0);
+}
+
+void IAStringIndex::clear()
+{
+    for (int i = 0; i < entries.count(); i++)
+        entries[i].count = 0;
+}
+
+QStringList IAStringIndex::strings() const
+{
+    QStringList strings;
+    for (int i = 0; i < entries.count(); i++) {
+        if (entries[i].count > 0)
+            strings << entries[i].spelling;
+    }
+    return strings;
+}
+
+int IAStringIndex::count(const QString &str) const
+{
+    int i = keySlots.value(str.toLower(), -1);
+    return i < 0 ? 0 : entries[i].count;
+}
+
+QHash<QString, int> IAStringIndex::counts() const
+{
+    QHash<QString, int> counts;
+    for (int i = 0; i < entries.count(); i++) {
+        if (entries[i].count > 0)
+            counts[entries[i].spelling] = entries[i].count;
+    }
+    return counts;
+}
+
+int IAStringIndex::slot(int id)
+{
+    // pool ids are mapped to the entry of their lower case string .. the
+    // lower case conversion is only done the first time an id is seen
+    if (id < idSlots.count() && idSlots[id] >= 0)
+        return idSlots[id];
+
+    QString key = IAStringPool::string(id).toLower();
+    QHash<QString, int>::const_iterator i = keySlots.constFind(key);
+    int slot;
+    if (i != keySlots.constEnd()) {
+        slot = i.value();
+    }
+    else {
+        Entry entry;
+        entry.count = 0;
+        slot = entries.count();
+        entries << entry;
+        keySlots.insert(key, slot);
+    }
+
+    if (id >= idSlots.count())
+        idSlots.insert(idSlots.count(), id + 1 - idSlots.count(), -1);
+    idSlots[id] = slot;
+    return slot;
+}
+
+
+// ========== IAStringPool ==========
+
+int IAStringPool::intern(const QString &str)
+{
+    QMutexLocker locker(&stringPool.mutex);
+    QHash<QString, int>::const_iterator i = stringPool.ids.constFind(str);
+    if (i != stringPool.ids.constEnd())
+        return i.value();
+
+    return stringPool.append(str);
+}
+
+QString IAStringPool::string(int id)
+{
+    // no lock .. the slot of a valid id is written once before the id is
+    // handed out
+    if (id < 0 || id >= int(stringPool.count))
+        return QString();
+
+    QString **table = stringPool.blocks;
+    return table[id >> IA_POOL_BLOCK_BITS][id & (IA_POOL_BLOCK_SIZE - 1)];
+}
+
+int IAStringPool::count()
+{
+    return stringPool.count;
+}
+
+
+// ========== IAObjType ==========
+
+IAObjType::IAObjType()
+{
+    id = 0; // NEW_OBJ_TYPE
+}
+
+IAObjType::IAObjType(const QString &str)
+{
+    id = IAStringPool::intern(str);
+}
+
+IAObjType &IAObjType::operator=(const QString &str)
+{
+    id = IAStringPool::intern(str);
+    return *this;
+}
+
+IAObjType::operator QString() const
+{
+    return IAStringPool::string(id);
+}
+
+bool IAObjType::operator==(const QString &str) const
+{
+    return IAStringPool::string(id) == str;
+}
+
+bool IAObjType::operator!=(const QString &str) const
+{
+    return IAStringPool::string(id) != str;
+}
+
+QString IAObjType::toString() const
+{
+    return IAStringPool::string(id);
+}
+
+QString IAObjType::toLower() const
+{
+    return IAStringPool::string(id).toLower();
+}
+
+bool IAObjType::isEmpty() const
+{
+    return IAStringPool::string(id).isEmpty();
+}
+
+
+// ========== IARange ==========
+
+IARange::IARange()
+{
+    offset = 0;
+    length = 0;
+}
+
+int IARange::count() const
+{
+    return length;
+}
+
+int IARange::size() const
+{
+    return length;
+}
+
+bool IARange::isEmpty() const
+{
+    return length == 0;
 }
 
 
@@ -383,14 +1410,517 @@ void ImgAnnotation::clear()
 
 IAObj::IAObj()
 {
-    // init the parameters
-    type = NEW_OBJ_TYPE;
+    // init the parameters .. the type starts as NEW_OBJ_TYPE
+    id = 0;
     score = 0.0;
     comboScore = 0.0;
 }
 
-bool IAObj::isEmpty()
+bool IAObj::isEmpty() const
 {
-    return (type.isEmpty() || type == NEW_OBJ_TYPE)
+    return (type.id == 0 || type.isEmpty())
         && tags.isEmpty() && fixPoints.isEmpty() && box.isEmpty();
 }
+
+
+// ========== IAFile ==========
+
+IAFile::IAFile()
+{
+    unusedTags = 0;
+    unusedFixPoints = 0;
+}
+
+int IAFile::append(const IAObj &obj, const QStringList &tags, const QList<QPointF> &fixPoints)
+{
+    // the new object starts without tags and fix points at the end of the
+    // arrays .. ranges of a copied object belong to another file
+    objects << obj;
+    int objIndex = objects.count() - 1;
+    IAObj &newObj = objects[objIndex];
+    newObj.tags.offset = tagArray.count();
+    newObj.tags.length = 0;
+    newObj.fixPoints.offset = fixPointArray.count();
+    newObj.fixPoints.length = 0;
+
+    if (!tags.isEmpty())
+        setTags(objIndex, tags);
+    if (!fixPoints.isEmpty())
+        setFixPoints(objIndex, fixPoints);
+    else
+        spatialIndex.update(objIndex);
+
+    return objIndex;
+}
+
+void IAFile::dropRanges(const IAObj &obj)
+{
+    // the ranges stay in the arrays until they get squeezed
+    unusedTags += obj.tags.length;
+    unusedFixPoints += obj.fixPoints.length;
+}
+
+void IAFile::remove(int objIndex)
+{
+    if (objIndex < 0 || objIndex >= objects.count())
+        return;
+
+    dropRanges(objects[objIndex]);
+    objects.remove(objIndex);
+    spatialIndex.invalidate();
+
+    if (2 * unusedTags > tagArray.count() || 2 * unusedFixPoints > fixPointArray.count())
+        squeeze();
+}
+
+int IAFile::remove(const QBitArray &marked)
+{
+    // compact the objects in place .. each remaining object moves at most
+    // once, the arrays are squeezed at most once
+    int count = objects.count();
+    IAObj *data = objects.data();
+    int dst = 0;
+    for (int src = 0; src < count; src++) {
+        if (src < marked.size() && marked.testBit(src)) {
+            dropRanges(data[src]);
+            continue;
+        }
+        if (dst != src)
+            data[dst] = data[src];
+        dst++;
+    }
+    if (dst != count) {
+        objects.resize(dst);
+        spatialIndex.invalidate();
+        if (2 * unusedTags > tagArray.count() || 2 * unusedFixPoints > fixPointArray.count())
+            squeeze();
+    }
+
+    return count - dst;
+}
+
+void IAFile::reserve(int objCount)
+{
+    // reserve room for additional objects
+    objects.reserve(objects.count() + objCount);
+}
+
+void IAFile::squeeze()
+{
+    // rebuild the arrays with the ranges of the remaining objects only
+    QVector<int> newTags;
+    QVector<QPointF> newFixPoints;
+    newTags.reserve(tagArray.count() - unusedTags);
+    newFixPoints.reserve(fixPointArray.count() - unusedFixPoints);
+    for (int i = 0; i < objects.count(); i++) {
+        IAObj &obj = objects[i];
+        int tagOffset = newTags.count();
+        for (int j = 0; j < obj.tags.length; j++)
+            newTags << tagArray[obj.tags.offset + j];
+        obj.tags.offset = tagOffset;
+
+        int fixPointOffset = newFixPoints.count();
+        for (int j = 0; j < obj.fixPoints.length; j++)
+            newFixPoints << fixPointArray[obj.fixPoints.offset + j];
+        obj.fixPoints.offset = fixPointOffset;
+    }
+
+    tagArray = newTags;
+    fixPointArray = newFixPoints;
+    unusedTags = 0;
+    unusedFixPoints = 0;
+}
+
+qint64 IAFile::byteCount() const
+{
+    // the allocated capacity of the three arrays .. the strings of the
+    // types/tags are shared through the pool and not counted here
+    return qint64(objects.capacity()) * sizeof(IAObj)
+        + qint64(tagArray.capacity()) * sizeof(int)
+        + qint64(fixPointArray.capacity()) * sizeof(QPointF);
+}
+
+QStringList IAFile::tags(int objIndex) const
+{
+    QStringList tags;
+    const int *ids = tagIds(objIndex);
+    for (int i = 0; ids != NULL && i < objects[objIndex].tags.length; i++)
+        tags << IAStringPool::string(ids[i]);
+    return tags;
+}
+
+const int *IAFile::tagIds(int objIndex) const
+{
+    if (objIndex < 0 || objIndex >= objects.count())
+        return NULL;
+
+    return tagArray.constData() + objects[objIndex].tags.offset;
+}
+
+void IAFile::setTags(int objIndex, const QStringList &tags)
+{
+    QVarLengthArray<int, 32> ids(tags.count());
+    for (int i = 0; i < tags.count(); i++)
+        ids[i] = IAStringPool::intern(tags[i]);
+    setTagIds(objIndex, ids.constData(), ids.size());
+}
+
+void IAFile::setTagIds(int objIndex, const int *ids, int count)
+{
+    if (objIndex < 0 || objIndex >= objects.count())
+        return;
+
+    // take a copy if the ids point into our own array, it might get reallocated
+    QVarLengthArray<int, 32> copy;
+    if (count > 0 && ids >= tagArray.constData() && ids < tagArray.constData() + tagArray.count()) {
+        copy.append(ids, count);
+        ids = copy.constData();
+    }
+
+    // overwrite the current range if the tags fit in or if it is the last
+    // one in the array .. otherwise start a new range at the end
+    IARange &range = objects[objIndex].tags;
+    if (range.offset + range.length == tagArray.count()) {
+        tagArray.resize(range.offset + count);
+    }
+    else if (count <= range.length) {
+        unusedTags += range.length - count;
+    }
+    else {
+        unusedTags += range.length;
+        range.offset = tagArray.count();
+        tagArray.resize(range.offset + count);
+    }
+    if (count > 0)
+        memcpy(tagArray.data() + range.offset, ids, count * sizeof(int));
+    range.length = count;
+}
+
+QList<QPointF> IAFile::fixPoints(int objIndex) const
+{
+    QList<QPointF> points;
+    const QPointF *data = fixPointData(objIndex);
+    for (int i = 0; data != NULL && i < objects[objIndex].fixPoints.length; i++)
+        points << data[i];
+    return points;
+}
+
+const QPointF *IAFile::fixPointData(int objIndex) const
+{
+    if (objIndex < 0 || objIndex >= objects.count())
+        return NULL;
+
+    return fixPointArray.constData() + objects[objIndex].fixPoints.offset;
+}
+
+void IAFile::setFixPoints(int objIndex, const QList<QPointF> &points)
+{
+    if (objIndex < 0 || objIndex >= objects.count())
+        return;
+
+    // drop the current points .. the range is reused if it is the last one
+    // in the array, otherwise it is left to the next squeeze
+    IARange &range = objects[objIndex].fixPoints;
+    if (range.offset + range.length == fixPointArray.count())
+        fixPointArray.resize(range.offset);
+    else
+        unusedFixPoints += range.length;
+    range.offset = fixPointArray.count();
+    range.length = 0;
+    if (points.isEmpty()) {
+        spatialIndex.update(objIndex);
+        return;
+    }
+
+    QVarLengthArray<QPointF, 64> data(points.count());
+    for (int i = 0; i < points.count(); i++)
+        data[i] = points[i];
+    appendFixPoints(objIndex, data.constData(), data.size());
+}
+
+void IAFile::appendFixPoints(int objIndex, const QPointF *points, int count)
+{
+    if (objIndex < 0 || objIndex >= objects.count() || count <= 0)
+        return;
+
+    // take a copy if the points are part of the array, it might get
+    // reallocated while growing
+    QVarLengthArray<QPointF, 64> copy;
+    if (points >= fixPointArray.constData() && points < fixPointArray.constData() + fixPointArray.count()) {
+        copy.append(points, count);
+        points = copy.constData();
+    }
+
+    IARange &range = objects[objIndex].fixPoints;
+    if (range.offset + range.length != fixPointArray.count()) {
+        // the range cannot grow in place .. move it to the end of the array
+        int offset = fixPointArray.count();
+        fixPointArray.resize(offset + range.length + count);
+        QPointF *data = fixPointArray.data();
+        for (int i = 0; i < range.length; i++)
+            data[offset + i] = data[range.offset + i];
+        unusedFixPoints += range.length;
+        range.offset = offset;
+    }
+    else {
+        fixPointArray.resize(range.offset + range.length + count);
+    }
+
+    QPointF *data = fixPointArray.data() + range.offset + range.length;
+    for (int i = 0; i < count; i++)
+        data[i] = points[i];
+    range.length += count;
+    spatialIndex.update(objIndex);
+}
+
+bool IAFile::bounds(int objIndex, QRectF &rect) const
+{
+    if (objIndex < 0 || objIndex >= objects.count())
+        return false;
+
+    // bounding rect of the box and the fix points .. objects without both
+    // have no bounds
+    const IAObj &obj = objects[objIndex];
+    bool hasBounds = !obj.box.isNull();
+    qreal x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    if (hasBounds) {
+        QRectF box = obj.box.normalized();
+        x0 = box.left();
+        y0 = box.top();
+        x1 = box.right();
+        y1 = box.bottom();
+    }
+
+    const QPointF *points = fixPointArray.constData() + obj.fixPoints.offset;
+    for (int i = 0; i < obj.fixPoints.count(); i++) {
+        if (!hasBounds) {
+            x0 = x1 = points[i].x();
+            y0 = y1 = points[i].y();
+            hasBounds = true;
+            continue;
+        }
+        x0 = qMin(x0, points[i].x());
+        y0 = qMin(y0, points[i].y());
+        x1 = qMax(x1, points[i].x());
+        y1 = qMax(y1, points[i].y());
+    }
+
+    if (hasBounds)
+        rect.setCoords(x0, y0, x1, y1);
+    return hasBounds;
+}
+
+void IAFile::updateBounds(int objIndex)
+{
+    spatialIndex.update(objIndex);
+}
+
+QVector<int> IAFile::objectsIn(const QRectF &rect) const
+{
+    QVector<int> result;
+    spatialIndex.query(*this, rect.normalized(), result);
+    return result;
+}
+
+QVector<int> IAFile::objectsAt(const QPointF &pos, qreal tolerance) const
+{
+    QVector<int> candidates;
+    spatialIndex.query(*this, QRectF(pos.x() - tolerance, pos.y() - tolerance, 2 * tolerance, 2 * tolerance), candidates);
+
+    // keep the objects whose box contains the point or that have a fix
+    // point close to it
+    QVector<int> result;
+    qreal tolerance2 = tolerance * tolerance;
+    for (int i = 0; i < candidates.count(); i++) {
+        const IAObj &obj = objects[candidates[i]];
+        bool hit = false;
+        if (!obj.box.isNull()) {
+            QRectF box = obj.box.normalized();
+            hit = pos.x() >= box.left() - tolerance && pos.x() <= box.right() + tolerance
+                && pos.y() >= box.top() - tolerance && pos.y() <= box.bottom() + tolerance;
+        }
+
+        const QPointF *points = fixPointArray.constData() + obj.fixPoints.offset;
+        for (int j = 0; !hit && j < obj.fixPoints.count(); j++) {
+            qreal dx = points[j].x() - pos.x();
+            qreal dy = points[j].y() - pos.y();
+            hit = dx * dx + dy * dy <= tolerance2;
+        }
+
+        if (hit)
+            result << candidates[i];
+    }
+    return result;
+}
+
+
+// ========== IASpatialIndex ==========
+
+// objects that cover more grid cells than this are kept in a separate list
+#define IA_GRID_MAX_CELLS_PER_OBJ 16
+
+// the grid is rebuilt if more than this many objects (or 1/8 of all
+// objects) changed since it was built
+#define IA_GRID_MAX_PENDING 64
+
+IASpatialIndex::IASpatialIndex()
+{
+    valid = false;
+    cols = 0;
+    rows = 0;
+    objCount = 0;
+    stamp = 0;
+}
+
+void IASpatialIndex::invalidate()
+{
+    valid = false;
+    pendingItems.clear();
+}
+
+void IASpatialIndex::update(int objIndex)
+{
+    // nothing to do as long as the grid has not been built
+    if (!valid)
+        return;
+
+    // the object might still be listed in its old cells .. queries check
+    // the current bounds anyway, so that only costs a bit of time
+    pendingItems << objIndex;
+    if (pendingItems.count() > IA_GRID_MAX_PENDING && pendingItems.count() > objCount / 8)
+        invalidate();
+}
+
+void IASpatialIndex::build(const IAFile &file) const
+{
+    int nObjs = file.objects.count();
+    objCount = nObjs;
+    QVector<QRectF> bounds(nObjs);
+    QBitArray hasBounds(nObjs);
+
+    // get the extent of all objects
+    extent = QRectF();
+    bool first = true;
+    qreal x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    int nIndexed = 0;
+    for (int i = 0; i < nObjs; i++) {
+        if (!file.bounds(i, bounds[i]))
+            continue;
+
+        hasBounds.setBit(i);
+        nIndexed++;
+        const QRectF &b = bounds[i];
+        if (first) {
+            x0 = b.left(); y0 = b.top(); x1 = b.right(); y1 = b.bottom();
+            first = false;
+        }
+        else {
+            x0 = qMin(x0, b.left()); y0 = qMin(y0, b.top());
+            x1 = qMax(x1, b.right()); y1 = qMax(y1, b.bottom());
+        }
+    }
+    extent.setCoords(x0, y0, x1, y1);
+
+    // choose about one cell per object with roughly square cells
+    qreal w = qMax(extent.width(), qreal(1e-6));
+    qreal h = qMax(extent.height(), qreal(1e-6));
+    int nCells = qBound(1, nIndexed, 1 << 20);
+    cols = qBound(1, qRound(qSqrt(nCells * w / h)), nCells);
+    rows = qMax(1, nCells / cols);
+    qreal cellW = w / cols;
+    qreal cellH = h / rows;
+
+    // count the entries per cell, then fill them in .. the cells are stored
+    // as ranges in one array
+    cellStart.fill(0, rows * cols + 1);
+    largeItems.clear();
+    QVector<QRect> cellRanges(nObjs);
+    for (int i = 0; i < nObjs; i++) {
+        if (!hasBounds.testBit(i))
+            continue;
+
+        const QRectF &b = bounds[i];
+        int c0 = qBound(0, int((b.left() - extent.left()) / cellW), cols - 1);
+        int c1 = qBound(0, int((b.right() - extent.left()) / cellW), cols - 1);
+        int r0 = qBound(0, int((b.top() - extent.top()) / cellH), rows - 1);
+        int r1 = qBound(0, int((b.bottom() - extent.top()) / cellH), rows - 1);
+        if ((c1 - c0 + 1) * (r1 - r0 + 1) > IA_GRID_MAX_CELLS_PER_OBJ) {
+            largeItems << i;
+            continue;
+        }
+
+        cellRanges[i].setCoords(c0, r0, c1, r1);
+        for (int r = r0; r <= r1; r++)
+            for (int c = c0; c <= c1; c++)
+                cellStart[r * cols + c + 1]++;
+    }
+    for (int i = 1; i < cellStart.count(); i++)
+        cellStart[i] += cellStart[i - 1];
+
+    cellItems.resize(cellStart.last());
+    QVector<int> fill(cellStart);
+    for (int i = 0; i < nObjs; i++) {
+        if (!hasBounds.testBit(i) || cellRanges[i].isNull())
+            continue;
+
+        const QRect &range = cellRanges[i];
+        for (int r = range.top(); r <= range.bottom(); r++)
+            for (int c = range.left(); c <= range.right(); c++)
+                cellItems[fill[r * cols + c]++] = i;
+    }
+
+    valid = true;
+}
+
+void IASpatialIndex::query(const IAFile &file, const QRectF &rect, QVector<int> &result) const
+{
+    result.clear();
+    if (!valid)
+        build(file);
+
+    int nObjs = file.objects.count();
+    if (stamps.count() < nObjs)
+        stamps.resize(nObjs);
+    if (++stamp == 0) {
+        stamps.fill(0);
+        stamp = 1;
+    }
+
+    // test the objects of all cells that overlap with the rect, plus the
+    // large and pending ones
+    if (rect.left() <= extent.right() && extent.left() <= rect.right()
+        && rect.top() <= extent.bottom() && extent.top() <= rect.bottom()) {
+        qreal cellW = qMax(extent.width(), qreal(1e-6)) / cols;
+        qreal cellH = qMax(extent.height(), qreal(1e-6)) / rows;
+        int c0 = qBound(0, int((rect.left() - extent.left()) / cellW), cols - 1);
+        int c1 = qBound(0, int((rect.right() - extent.left()) / cellW), cols - 1);
+        int r0 = qBound(0, int((rect.top() - extent.top()) / cellH), rows - 1);
+        int r1 = qBound(0, int((rect.bottom() - extent.top()) / cellH), rows - 1);
+        for (int r = r0; r <= r1; r++) {
+            for (int c = c0; c <= c1; c++) {
+                int cell = r * cols + c;
+                for (int j = cellStart[cell]; j < cellStart[cell + 1]; j++)
+                    test(file, cellItems[j], rect, result);
+            }
+        }
+    }
+    for (int j = 0; j < largeItems.count(); j++)
+        test(file, largeItems[j], rect, result);
+    for (int j = 0; j < pendingItems.count(); j++)
+        test(file, pendingItems[j], rect, result);
+
+    qSort(result);
+}
+
+void IASpatialIndex::test(const IAFile &file, int objIndex, const QRectF &rect, QVector<int> &result) const
+{
+    // test each candidate only once per query against its current bounds
+    if (objIndex >= file.objects.count() || stamps[objIndex] == stamp)
+        return;
+    stamps[objIndex] = stamp;
+
+    QRectF b;
+    if (file.bounds(objIndex, b) && b.left() <= rect.right() && rect.left() <= b.right()
+        && b.top() <= rect.bottom() && rect.top() <= b.bottom())
+        result << objIndex;
+}
@@ -26,34 +26,195 @@
 #include <QString>
 #include <QStringList>
 #include <QList>
+#include <QVector>
 #include <QHash>
 #include <QPointF>
 #include <QRectF>
+#include <QBitArray>
+#include <QPair>
+
+// a file handle stays the same for a dir/file name as long as the
+// ImgAnnotation exists .. also if the file is removed and added again
+typedef int IAFileHandle;
+#define IA_INVALID_HANDLE -1
 
 #define NEW_OBJ_TYPE "<none>"
 
 class ImgAnnotation;
 
+// process wide pool for object types and tags .. each distinct string is
+// stored only once and objects refer to it by its id. strings never move
+// once interned, so looking them up does not take a lock
+class IAStringPool {
+public:
+    static int intern(const QString &);
+    static QString string(int);
+    static int count();
+};
+
+
+// refcounted, case insensitive index over pool strings .. it answers which
+// object types/tags are in use without looking at the objects
+class IAStringIndex {
+public:
+    void add(int id, int count = 1);
+    void remove(int id, int count = 1);
+    void clear();
+    QStringList strings() const;
+    int count(const QString &) const;
+    QHash<QString, int> counts() const;
+
+private:
+    int slot(int id);
+
+    class Entry {
+    public:
+        QString spelling;
+        int count;
+    };
+
+    QVector<Entry> entries;
+    QHash<QString, int> keySlots;
+    QVector<int> idSlots;
+};
+
+
+// the type of an object .. an interned string that reads and assigns like
+// the QString it used to be
+class IAObjType {
+public:
+    IAObjType();
+    explicit IAObjType(const QString &);
+    IAObjType &operator=(const QString &);
+    operator QString() const;
+    bool operator==(const QString &) const;
+    bool operator!=(const QString &) const;
+    QString toString() const;
+    QString toLower() const;
+    bool isEmpty() const;
+
+public:
+    // the id in IAStringPool
+    int id;
+};
+
+
+// where the tags or the fix points of an object are kept in the flat
+// arrays of its file .. the elements are read and written through
+// IAFile::tags()/fixPoints() and their id/raw data variants
+class IARange {
+public:
+    IARange();
+    int count() const;
+    int size() const;
+    bool isEmpty() const;
+
+public:
+    int offset;
+    int length;
+};
+
+
+// an object is a plain record that is stored by value in its file .. the
+// type is an id into the string pool, the tags and fix points are ranges
+// in the arrays of the file. an object that is not part of a file has no
+// tags and fix points, they are passed along when it is added
 class IAObj {
 public:
-    QString type;
+    IAObjType type;
+    uint id;
     QString tmp;
-    QStringList tags;
-    QList<QPointF> fixPoints;
+    IARange tags;
+    IARange fixPoints;
     QRectF box;
-    uint id;
     double score;
     double comboScore;
 
 public:
     IAObj();
-    bool isEmpty();
+    bool isEmpty() const;
 };
+Q_DECLARE_TYPEINFO(IAObj, Q_MOVABLE_TYPE);
+
 
+class IAFile;
 
+// uniform grid over the bounds (box and fix points) of the objects of a
+// file .. it is built on the first query, objects that are added or moved
+// afterwards are kept in a pending list until the grid is rebuilt
+class IASpatialIndex {
+public:
+    IASpatialIndex();
+    void invalidate();
+    void update(int objIndex);
+    void query(const IAFile &, const QRectF &, QVector<int> &) const;
+
+private:
+    void build(const IAFile &) const;
+    void test(const IAFile &, int objIndex, const QRectF &, QVector<int> &) const;
+
+    mutable bool valid;
+    mutable QRectF extent;
+    mutable int cols;
+    mutable int rows;
+    mutable int objCount;
+    mutable QVector<int> cellStart;
+    mutable QVector<int> cellItems;
+    mutable QVector<int> largeItems;
+    QVector<int> pendingItems;
+
+    // visit marks to report each object only once per query
+    mutable QVector<uint> stamps;
+    mutable uint stamp;
+};
+
+
+// the objects of a file in one array, their tags (pool ids) and fix points
+// in two more .. ranges that are dropped or moved stay in the arrays until
+// they make up half of it, then the arrays are squeezed
 class IAFile {
 public:
-    QList<IAObj> objects;
+    // direct changes to the box of an object need a call of updateBounds(),
+    // objects are added and removed through the methods below
+    QVector<IAObj> objects;
+
+public:
+    IAFile();
+    int append(const IAObj &, const QStringList &tags = QStringList(), const QList<QPointF> &fixPoints = QList<QPointF>());
+    void remove(int objIndex);
+    int remove(const QBitArray &marked);
+    void reserve(int objCount);
+    void squeeze();
+    // memory held by the objects and the arrays
+    qint64 byteCount() const;
+
+    // shortcuts to the tags/fix points of an object
+    QStringList tags(int objIndex) const;
+    const int *tagIds(int objIndex) const;
+    void setTags(int objIndex, const QStringList &);
+    void setTagIds(int objIndex, const int *, int);
+
+    QList<QPointF> fixPoints(int objIndex) const;
+    const QPointF *fixPointData(int objIndex) const;
+    void setFixPoints(int objIndex, const QList<QPointF> &);
+    void appendFixPoints(int objIndex, const QPointF *, int);
+
+    // spatial queries .. the object indexes are returned in ascending order
+    bool bounds(int objIndex, QRectF &) const;
+    void updateBounds(int objIndex);
+    QVector<int> objectsIn(const QRectF &) const;
+    QVector<int> objectsAt(const QPointF &, qreal tolerance = 0.0) const;
+
+private:
+    friend class ImgAnnotation;
+
+    void dropRanges(const IAObj &);
+
+    QVector<int> tagArray;
+    QVector<QPointF> fixPointArray;
+    int unusedTags;
+    int unusedFixPoints;
+    IASpatialIndex spatialIndex;
 };
 
 
@@ -67,32 +228,93 @@ class ImgAnnotation : public QObject
 {
     Q_OBJECT
 
-public:
-    // hash that stores the directories
-    QHash<QString, IADir> dirs;
-
 public:
     ImgAnnotation();
     void addFiles(const QStringList&);
     void removeFiles(const QStringList&);
     void loadFromFile(const QString&);
-    void saveToFile(const QString&);
+    bool saveToFile(const QString&);
+    bool loadSnapshot(const QString&);
+    bool saveSnapshot(const QString&) const;
     QStringList getAllTags() const;
     QStringList getAllObjTypes() const;
+    int getTagCount(const QString &) const;
+    int getObjTypeCount(const QString &) const;
+    QHash<QString, int> getObjTypeCounts() const;
 
     QList<QString> getDirs() const;
-    QList<QString> getDirFiles(const QString dir) const;
-    QList<IAObj> *getObj(const QString dir, const QString file);
-    IAObj *getObj(const QString dir, const QString file, const int objIndex);
-    IAFile *getFile(const QString dir, const QString file);
-    void newObj(const QString, const QString, const QString = NEW_OBJ_TYPE);
-    void newObj(const QString, const QString, const IAObj &);
-    void removeObj(const QString, const QString, const QList<int>);
+    QList<QString> getDirFiles(const QString &dir) const;
+
+    // handle based access .. resolve the handle once and use it in loops
+    IAFileHandle fileHandle(const QString &dir, const QString &file) const;
+    IAFileHandle createFile(const QString &dir, const QString &file);
+    QString handleDir(IAFileHandle) const;
+    QString handleFile(IAFileHandle) const;
+    IAFile *getFile(IAFileHandle);
+    const IAFile *getFile(IAFileHandle) const;
+    QVector<IAObj> *getObj(IAFileHandle);
+    IAObj *getObj(IAFileHandle, const int objIndex);
+    // tags and fix points of a new object are passed along, the ranges of
+    // an object only have a meaning in the file it is stored in
+    void newObj(IAFileHandle, const IAObj &, const QStringList &tags = QStringList(), const QList<QPointF> &fixPoints = QList<QPointF>());
+    void newObjs(IAFileHandle, const QList<IAObj> &);
+    void setObjType(IAFileHandle, const int, const QString &);
+    void setObjTags(IAFileHandle, const int, const QStringList &);
+    void setObjBox(IAFileHandle, const int, const QRectF &);
+    void removeObjs(IAFileHandle, const QList<int> &);
+
+    // name based access
+    QVector<IAObj> *getObj(const QString &dir, const QString &file);
+    IAObj *getObj(const QString &dir, const QString &file, const int objIndex);
+    IAFile *getFile(const QString &dir, const QString &file);
+    void newObj(const QString &, const QString &, const QString & = NEW_OBJ_TYPE);
+    void newObj(const QString &, const QString &, const IAObj &);
+    void newObjs(const QString &, const QString &, const QList<IAObj> &);
+    void setObjType(const QString &, const QString &, const int, const QString &);
+    void setObjTags(const QString &, const QString &, const int, const QStringList &);
+    void setObjBox(const QString &, const QString &, const int, const QRectF &);
+    void removeObj(const QString &, const QString &, const QList<int>);
+    void removeObjs(const QString &, const QString &, const QList<int> &);
+
     void clear();
+    void rebuildIndexes();
+
+private:
+    void indexFile(const IAFile &, int sign);
+    void indexObj(const IAFile &, int objIndex, int sign);
+    IAFileHandle registerFile(const QString &dir, const QString &file, IAFile *);
+    void emitObjectsChanged(IAFileHandle, int first, int last);
 
 signals:
     void filesChanged();
     void objectsChanged();
+    // first..last is the index range of the objects in the file that were
+    // added/changed .. for removals it is the range that got shifted, given
+    // in the numbering from before the removal
+    void objectsChanged(const QString &dir, const QString &file, int first, int last);
+
+private:
+    // hash that stores the directories .. only reachable through the
+    // methods above so the file handles pointing into it stay valid
+    QHash<QString, IADir> dirs;
+
+    // indexes over the types/tags of all objects .. they are kept up to date
+    // by the methods above, changes made directly to objects returned by
+    // getObj() require a call of rebuildIndexes()
+    IAStringIndex typeIndex;
+    IAStringIndex tagIndex;
+
+    // file handles .. the pointers are kept in sync by the methods above
+    // and by rebuildIndexes(), they are NULL for removed files
+    class FileRef {
+    public:
+        QString dir;
+        QString file;
+        IAFile *data;
+    };
+
+    QVector<FileRef> handles;
+    QHash<QPair<QString, QString>, int> handleIds;
 };
 
 
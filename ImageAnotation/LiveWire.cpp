@@ -0,0 +1,171 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "LiveWire.h"
+
+#include <limits.h>
+
+namespace
+{
+    // the step costs of straight and diagonal moves are cost * 10 and
+    // cost * 14 .. the queue has to cover the largest step
+    const int BUCKET_COUNT = 4096;
+}
+
+
+LiveWire::LiveWire()
+{
+    _current = 0;
+    _queued = 0;
+}
+
+QRect LiveWire::window(const QSize &image_size, const QPoint &anchor)
+{
+    QRect window(anchor.x() - LIVE_WIRE_ROI_SIZE / 2, anchor.y() - LIVE_WIRE_ROI_SIZE / 2, LIVE_WIRE_ROI_SIZE, LIVE_WIRE_ROI_SIZE);
+    return window & QRect(QPoint(0, 0), image_size);
+}
+
+void LiveWire::start(const QImage &image, const QRect &window, const QPoint &anchor)
+{
+    clear();
+    if (!window.contains(anchor) || image.size() != window.size())
+        return;
+
+    const int w = window.width();
+    const int h = window.height();
+    QImage rgb = image.convertToFormat(QImage::Format_RGB32);
+
+    // the cost map .. gradient magnitude (central differences) and intensity
+    // of the green channel
+    QVector<uchar> green(w * h);
+    for (int y = 0; y < h; ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(rgb.constScanLine(y));
+        uchar *g = green.data() + y * w;
+        for (int x = 0; x < w; ++x)
+            g[x] = uchar(qGreen(line[x]));
+    }
+    QVector<int> gradients(w * h, 0);
+    int maxGradient = 1;
+    for (int y = 1; y < h - 1; ++y) {
+        const uchar *g = green.constData() + y * w;
+        int *d = gradients.data() + y * w;
+        for (int x = 1; x < w - 1; ++x) {
+            d[x] = qAbs(int(g[x + 1]) - int(g[x - 1])) + qAbs(int(g[x + w]) - int(g[x - w]));
+            maxGradient = qMax(maxGradient, d[x]);
+        }
+    }
+    _costs.resize(w * h);
+    for (int i = 0; i < w * h; ++i) {
+        int cost = 1 + LIVE_WIRE_GRADIENT_WEIGHT * (maxGradient - gradients[i]) / maxGradient
+            + LIVE_WIRE_INTENSITY_WEIGHT * green[i] / 255;
+        _costs[i] = uchar(qMin(cost, 255));
+    }
+
+    _distances.fill(INT_MAX, w * h);
+    _parents.fill(-1, w * h);
+    _settled.fill(false, w * h);
+    _buckets.resize(BUCKET_COUNT);
+
+    int start = (anchor.y() - window.y()) * w + anchor.x() - window.x();
+    _distances[start] = 0;
+    _buckets[0].append(start);
+    _current = 0;
+    _queued = 1;
+    _roi = window;
+    _anchor = anchor;
+}
+
+void LiveWire::clear()
+{
+    _roi = QRect();
+    _costs.clear();
+    _distances.clear();
+    _parents.clear();
+    _settled.clear();
+    _buckets.clear();
+    _queued = 0;
+}
+
+bool LiveWire::is_active() const
+{
+    return !_roi.isEmpty();
+}
+
+QPoint LiveWire::anchor() const
+{
+    return _anchor;
+}
+
+QPolygon LiveWire::path(const QPoint &target)
+{
+    QPolygon path;
+    if (!is_active())
+        return path;
+
+    QPoint t(qBound(_roi.left(), target.x(), _roi.right()), qBound(_roi.top(), target.y(), _roi.bottom()));
+    const int w = _roi.width();
+    int p = (t.y() - _roi.y()) * w + t.x() - _roi.x();
+    expand_i(p);
+
+    // walk back to the anchor
+    for (; p >= 0; p = _parents[p])
+        path.prepend(QPoint(_roi.x() + p % w, _roi.y() + p / w));
+    return path;
+}
+
+void LiveWire::expand_i(int target)
+{
+    // settle pixels in the order of their distance until the target is
+    // among them .. a stale queue entry is recognized by its distance
+    const int w = _roi.width();
+    const int h = _roi.height();
+    while (!_settled[target] && _queued > 0) {
+        QVector<int> &bucket = _buckets[_current % BUCKET_COUNT];
+        if (bucket.isEmpty()) {
+            _current++;
+            continue;
+        }
+        int p = bucket.last();
+        bucket.pop_back();
+        _queued--;
+        if (_settled[p] || _distances[p] != _current)
+            continue;
+        _settled[p] = true;
+
+        int x = p % w, y = p / w;
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                if ((dx == 0 && dy == 0) || x + dx < 0 || x + dx >= w || y + dy < 0 || y + dy >= h)
+                    continue;
+                int q = p + dy * w + dx;
+                if (_settled[q])
+                    continue;
+                int distance = _current + _costs[q] * ((dx != 0 && dy != 0) ? 14 : 10);
+                if (distance < _distances[q]) {
+                    _distances[q] = distance;
+                    _parents[q] = p;
+                    _buckets[distance % BUCKET_COUNT].append(q);
+                    _queued++;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,79 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef LiveWire_H
+#define LiveWire_H
+
+#include <QVector>
+#include <QRect>
+#include <QPoint>
+#include <QPolygon>
+#include <QImage>
+
+// the path can only run within a window of this size around the anchor
+#define LIVE_WIRE_ROI_SIZE 512
+// weights of the cost terms .. strong edges and dark pixels (the vessels in
+// the green channel) are cheap
+#define LIVE_WIRE_GRADIENT_WEIGHT 40
+#define LIVE_WIRE_INTENSITY_WEIGHT 60
+
+
+// intelligent scissors .. the cheapest 8-connected path from an anchor to
+// the cursor over a cost map of the window around the anchor. the shortest
+// paths are expanded lazily (dijkstra with a bucket queue) and the state is
+// kept between calls, so following the cursor only settles the pixels that
+// are reached for the first time
+class LiveWire
+{
+public:
+    LiveWire();
+
+    // the window of the image the path may run in
+    static QRect window(const QSize &image_size, const QPoint &anchor);
+    // image is the part of the picture within window(), anchor in picture
+    // coordinates
+    void start(const QImage &image, const QRect &window, const QPoint &anchor);
+    void clear();
+    bool is_active() const;
+    QPoint anchor() const;
+
+    // the path from the anchor to target (moved into the window), both ends
+    // included
+    QPolygon path(const QPoint &target);
+
+private:
+    void expand_i(int target);
+
+private:
+    QRect _roi;
+    QPoint _anchor;
+    // per pixel of the roi
+    QVector<uchar> _costs;
+    QVector<int> _distances;
+    QVector<int> _parents;
+    QVector<bool> _settled;
+    // circular bucket queue over the distances
+    QVector<QVector<int> > _buckets;
+    int _current;
+    int _queued;
+};
+
+#endif
@@ -0,0 +1,171 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "MagicWand.h"
+
+
+MagicWand::MagicWand()
+{
+}
+
+QRect MagicWand::window(const QSize &image_size, const QPoint &seed)
+{
+    QRect window(seed.x() - MAGIC_WAND_ROI_SIZE / 2, seed.y() - MAGIC_WAND_ROI_SIZE / 2, MAGIC_WAND_ROI_SIZE, MAGIC_WAND_ROI_SIZE);
+    return window & QRect(QPoint(0, 0), image_size);
+}
+
+void MagicWand::start(const QImage &image, const QRect &window, const QPoint &seed)
+{
+    clear();
+    QRect roi = window;
+    if (!roi.contains(seed) || image.size() != roi.size())
+        return;
+
+    const int w = roi.width();
+    const int h = roi.height();
+    QImage rgb = image.convertToFormat(QImage::Format_RGB32);
+
+    // the colour distance to the seed (largest channel difference) .. one
+    // branch free pass over plain arrays
+    QVector<uchar> distance(w * h);
+    QRgb seedRgb = rgb.pixel(seed - roi.topLeft());
+    const int sr = qRed(seedRgb), sg = qGreen(seedRgb), sb = qBlue(seedRgb);
+    for (int y = 0; y < h; ++y) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(rgb.constScanLine(y));
+        uchar *d = distance.data() + y * w;
+        for (int x = 0; x < w; ++x) {
+            int dr = qAbs(qRed(line[x]) - sr);
+            int dg = qAbs(qGreen(line[x]) - sg);
+            int db = qAbs(qBlue(line[x]) - sb);
+            d[x] = uchar(qMax(dr, qMax(dg, db)));
+        }
+    }
+
+    // flood from the seed, lowest level first (one bucket per level) ..
+    // the level a pixel is reached with first is already its final one
+    _levels.resize(w * h);
+    QVector<bool> reached(w * h, false);
+    QVector<QVector<int> > buckets(256);
+    QVector<int> minX(256, w), maxX(256, -1), minY(256, h), maxY(256, -1);
+    int start = (seed.y() - roi.y()) * w + seed.x() - roi.x();
+    reached[start] = true;
+    _levels[start] = 0;
+    buckets[0].append(start);
+    for (int level = 0; level < 256; ++level) {
+        QVector<int> &bucket = buckets[level];
+        while (!bucket.isEmpty()) {
+            int p = bucket.last();
+            bucket.pop_back();
+            int x = p % w, y = p / w;
+            minX[level] = qMin(minX[level], x);
+            maxX[level] = qMax(maxX[level], x);
+            minY[level] = qMin(minY[level], y);
+            maxY[level] = qMax(maxY[level], y);
+
+            int neighbours[4];
+            int count = 0;
+            if (x > 0)
+                neighbours[count++] = p - 1;
+            if (x < w - 1)
+                neighbours[count++] = p + 1;
+            if (y > 0)
+                neighbours[count++] = p - w;
+            if (y < h - 1)
+                neighbours[count++] = p + w;
+            for (int i = 0; i < count; ++i) {
+                int q = neighbours[i];
+                if (reached[q])
+                    continue;
+                reached[q] = true;
+                int l = qMax(level, int(distance[q]));
+                _levels[q] = uchar(l);
+                buckets[l].append(q);
+            }
+        }
+        // keep the memory of the bucket, it will not be used again
+        bucket = QVector<int>();
+    }
+
+    _level_bounds.resize(256);
+    for (int level = 0; level < 256; ++level) {
+        if (maxX[level] >= 0)
+            _level_bounds[level] = QRect(QPoint(minX[level], minY[level]), QPoint(maxX[level], maxY[level]));
+    }
+    _roi = roi;
+}
+
+void MagicWand::clear()
+{
+    _roi = QRect();
+    _levels.clear();
+    _level_bounds.clear();
+}
+
+bool MagicWand::is_active() const
+{
+    return !_roi.isEmpty();
+}
+
+QRect MagicWand::roi() const
+{
+    return _roi;
+}
+
+QRect MagicWand::bounds(int tolerance) const
+{
+    QRect bounds;
+    for (int level = 0; level <= tolerance && level < _level_bounds.size(); ++level)
+        bounds |= _level_bounds[level];
+    return bounds.translated(_roi.topLeft());
+}
+
+QImage MagicWand::preview(int tolerance, QRgb color) const
+{
+    QRect rect = bounds(tolerance);
+    if (rect.isEmpty())
+        return QImage();
+
+    QImage image(rect.size(), QImage::Format_ARGB32_Premultiplied);
+    const int w = _roi.width();
+    const int x0 = rect.x() - _roi.x();
+    const int y0 = rect.y() - _roi.y();
+    for (int y = 0; y < rect.height(); ++y) {
+        const uchar *level = _levels.constData() + (y0 + y) * w + x0;
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < rect.width(); ++x)
+            line[x] = level[x] <= tolerance ? color : 0;
+    }
+    return image;
+}
+
+void MagicWand::fill(QImage &mask, int tolerance, QRgb value) const
+{
+    QRect rect = bounds(tolerance) & mask.rect();
+    const int w = _roi.width();
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        const uchar *level = _levels.constData() + (y - _roi.y()) * w + rect.x() - _roi.x();
+        QRgb *line = reinterpret_cast<QRgb *>(mask.scanLine(y)) + rect.x();
+        for (int x = 0; x < rect.width(); ++x) {
+            if (level[x] <= tolerance)
+                line[x] = value;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef MagicWand_H
+#define MagicWand_H
+
+#include <QVector>
+#include <QRect>
+#include <QPoint>
+#include <QImage>
+
+// the region only grows within a window of this size around the seed
+#define MAGIC_WAND_ROI_SIZE 1024
+// tolerance used when nothing else has been chosen
+#define MAGIC_WAND_DEFAULT_TOLERANCE 24
+
+
+// region growing from a seed pixel .. every pixel in a window around the
+// seed gets the smallest tolerance at which it is connected to the seed,
+// i.e., the largest colour distance (to the seed colour) along its best
+// path. the region at any tolerance is a plain threshold of these levels
+// then, so dragging the tolerance does not grow anything again
+class MagicWand
+{
+public:
+    MagicWand();
+
+    // the window of the image the region may grow in
+    static QRect window(const QSize &image_size, const QPoint &seed);
+    // image is the part of the picture within window(), seed in picture
+    // coordinates
+    void start(const QImage &image, const QRect &window, const QPoint &seed);
+    void clear();
+    bool is_active() const;
+    QRect roi() const;
+
+    // the bounding rect (image coordinates) of the region at tolerance
+    QRect bounds(int tolerance) const;
+    // the region in color on a transparent image, placed at bounds()
+    QImage preview(int tolerance, QRgb color) const;
+    // sets the pixels of the region in mask to value
+    void fill(QImage &mask, int tolerance, QRgb value) const;
+
+private:
+    QRect _roi;
+    // the connection level of each pixel of the roi
+    QVector<uchar> _levels;
+    // the bounding rect of the pixels of each level (roi coordinates)
+    QVector<QRect> _level_bounds;
+};
+
+#endif
@@ -29,13 +29,30 @@
 #include <QVector>
 #include <QList>
 #include <QColor>
+#include <QHash>
+#include <QSet>
+#include <QPersistentModelIndex>
 #include "ui_MainWindow.h"
 #include "PixmapWidget.h"
 #include "ImgAnnotation.h"
 #include "ScrollAreaNoWheel.h"
-
-
-class MainWindow : public QMainWindow, private Ui::MainWindow
+#include "MaskIndex.h"
+#include "MaskComponents.h"
+#include "ImageLoader.h"
+#include "MemoryBudget.h"
+#include "MaskWorkingSet.h"
+#include "MaskClassSchema.h"
+#include "ThumbnailLoader.h"
+#include "ImageTreeModel.h"
+#include "ImageEnhancer.h"
+#include "Superpixels.h"
+
+class QTimer;
+class QLabel;
+class QFileSystemWatcher;
+
+
+class MainWindow : public QMainWindow, private Ui::MainWindow, public MemoryClient
 {
     Q_OBJECT
 
@@ -50,6 +67,9 @@ public:
     QString get_current_obj_file();
     int get_current_obj_id() const;
 
+    // drops the oldest undo steps
+    virtual qint64 evict(int cache, qint64 bytes);
+
 protected:
     void closeEvent(QCloseEvent *event);
     void keyPressEvent(QKeyEvent * event);
@@ -64,28 +84,103 @@ private:
     void refresh_img_tree_i();
     void refresh_obj_mask_i();
     void switch_img_file(Direction);
+    QStringList get_mask_type_names() const;
+    void update_overlay_i();
+    QStringList get_image_list_i() const;
+    void update_components_i(const QString &image, int class_id, const QImage &mask, const QRect &dirty);
+    qint64 get_undo_bytes_i() const;
+    QString get_image_file_i(const QModelIndex &index) const;
+    void update_view_i();
+    void update_superpixels_i();
+    QStringList get_image_name_filters_i() const;
+    void watch_dir_i(const QString &dir);
+    void sync_dir_items_i(const QString &dir, QStringList &removedImages, QStringList &changedImages);
 
 private slots:
     void on_actionOpenDir_triggered();
+    void on_actionLoadAnnotations_triggered();
+    void on_actionExtractObjects_triggered();
+    void on_actionExportOutlines_triggered();
+    void on_actionMemoryLimit_triggered();
+    void on_actionShowThumbnails_toggled(bool);
     void on_actionQuit_triggered();
     void on_actionShortcutHelp_triggered();
     void on_actionUndo_triggered();
     void on_actionRedo_triggered();
 
-    void on_imgTreeWidget_currentItemChanged(QTreeWidgetItem *, QTreeWidgetItem *);
+    void slot_current_image_changed_i(const QModelIndex &, const QModelIndex &);
 
     void on_transparencySlider_valueChanged(int i);
     void on_objTypeComboBox_currentIndexChanged(int);
     void on_brushSizeComboBox_currentIndexChanged(int);
 
     void on_confidenceCheckBox_stateChanged(int);
+    void on_outlineCheckBox_toggled(bool);
+    void on_toolComboBox_currentIndexChanged(int);
+    void on_wandToleranceSlider_valueChanged(int);
+    void on_viewComboBox_currentIndexChanged(int);
+
+    void on_filterComboBox_currentIndexChanged(int);
+    void on_overlayCheckBox_toggled(bool);
+    void on_scoreSpinBox_valueChanged(double);
 
     void slot_wheel_turned_in_scroll_area_i(QWheelEvent *);
     void slot_mask_draw_i(QImage *mask);
+    void slot_apply_img_tree_filter_i();
+    void slot_extraction_progress_i(int done, int total);
+    void slot_extraction_finished_i();
+    void slot_image_loaded_i(const QString &file, const QImage &image);
+    void slot_memory_usage_changed_i(qint64 usage, qint64 limit);
+    void slot_mask_flush_failed_i(const QString &file);
+    void slot_update_thumbnails_i();
+    void slot_thumbnail_ready_i(const QString &file, const QImage &thumbnail);
+    void slot_directory_changed_i(const QString &path);
+    void slot_apply_directory_changes_i();
+    void slot_view_tile_ready_i(const QString &image, int mode, const QRect &rect, const QImage &tile);
+    void slot_view_finished_i(const QString &image, int mode);
+    void slot_superpixels_loaded_i(const QString &file, const Superpixels &superpixels);
 
 private:
     PixmapWidget *_pixmap_widget;
     ScrollAreaNoWheel *_scroll_area;
+    ImageTreeModel *_image_model;
+    MaskIndex *_mask_index;
+    ImgAnnotation *_annotation;
+    // the lesion objects extracted from the masks .. kept apart from the
+    // loaded annotation
+    ImgAnnotation *_lesions;
+    MaskComponentExtractor *_component_extractor;
+    ImageLoader *_image_loader;
+    ImageEnhancer *_image_enhancer;
+    SuperpixelLoader *_superpixel_loader;
+    // the image decoded in the background (empty if none)
+    QString _loading_image;
+    MemoryBudget *_memory_budget;
+    QLabel *_memory_label;
+    int _undo_cache;
+    MaskWorkingSet *_working_set;
+    ThumbnailLoader *_thumbnail_loader;
+    QTimer *_thumbnail_timer;
+    // the image entries which show a thumbnail, by image path
+    QHash<QString, QPersistentModelIndex> _thumbnail_items;
+
+    // watched directories (clean absolute path -> tree entry, and the tree
+    // entries themselves) and the ones changed since the last update
+    QFileSystemWatcher *_dir_watcher;
+    QTimer *_dir_timer;
+    QHash<QString, QString> _watched_dirs;
+    QSet<QString> _watched_entries;
+    QSet<QString> _changed_dirs;
+
+    // lesion components of the mask that is currently edited .. their
+    // objects are in _lesions
+    MaskComponentList _components;
+    QString _components_image;
+    int _components_class;
+    QTimer *_filter_timer;
+
+    // the classes masks can be drawn for
+    MaskClassSchema _mask_classes;
 
     QString _current_opened_direction;
     std::map<int , QString> _current_obj_file_collection;
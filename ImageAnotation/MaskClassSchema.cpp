@@ -0,0 +1,116 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "MaskClassSchema.h"
+
+#include <QFile>
+#include <QTextStream>
+#include "MaskIndex.h"
+
+
+MaskClassSchema::MaskClassSchema()
+{
+}
+
+bool MaskClassSchema::load(const QString &file_name)
+{
+    QFile file(file_name);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return false;
+
+    MaskClassSchema schema;
+    QTextStream in(&file);
+    in.setCodec("UTF-8");
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+        schema.add(line.section('\t', 0, 0).trimmed(), line.section('\t', 1).trimmed());
+    }
+
+    // keep what we have if the file does not define any class
+    if (schema.count() == 0)
+        return false;
+    *this = schema;
+    return true;
+}
+
+void MaskClassSchema::clear()
+{
+    _names.clear();
+    _tool_tips.clear();
+    _ids.clear();
+}
+
+bool MaskClassSchema::add(const QString &name, const QString &tool_tip)
+{
+    // names end up in file names .. they have to be unique
+    if (name.isEmpty() || _ids.contains(name))
+        return false;
+
+    _ids.insert(name, _names.size());
+    _names.append(name);
+    _tool_tips.append(tool_tip);
+    return true;
+}
+
+int MaskClassSchema::count() const
+{
+    return _names.size();
+}
+
+QString MaskClassSchema::name(int class_id) const
+{
+    if (class_id < 0 || class_id >= _names.size())
+        return QString();
+    return _names[class_id];
+}
+
+QString MaskClassSchema::tool_tip(int class_id) const
+{
+    if (class_id < 0 || class_id >= _tool_tips.size())
+        return QString();
+    return _tool_tips[class_id];
+}
+
+QStringList MaskClassSchema::names() const
+{
+    return _names.toList();
+}
+
+int MaskClassSchema::find(const QString &name) const
+{
+    return _ids.value(name, -1);
+}
+
+int MaskClassSchema::find_mask_file(const QString &mask_file, const QString &img_file) const
+{
+    // <prefix of the image><class name>.png .. the class name is cut out
+    // exactly, so "hemorrhages" never matches "hemorrhages spot"
+    QString prefix = MaskIndex::mask_file_prefix(img_file);
+    const QString suffix(".png");
+    if (mask_file.length() <= prefix.length() + suffix.length()
+        || !mask_file.startsWith(prefix)
+        || !mask_file.endsWith(suffix, Qt::CaseInsensitive))
+        return -1;
+
+    return find(mask_file.mid(prefix.length(), mask_file.length() - prefix.length() - suffix.length()));
+}
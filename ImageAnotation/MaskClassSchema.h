@@ -0,0 +1,60 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef MaskClassSchema_H
+#define MaskClassSchema_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+
+// name of the schema file looked for next to the executable
+#define MASK_CLASS_SCHEMA_FILE "mask_classes.txt"
+
+
+// the lesion classes masks can be drawn for .. the id of a class is its
+// position in the schema. the schema file is utf-8 text with one class per
+// line, "<name>" or "<name><tab><tool tip>", empty lines and lines starting
+// with '#' are skipped
+class MaskClassSchema
+{
+public:
+    MaskClassSchema();
+
+    bool load(const QString &file_name);
+    void clear();
+    bool add(const QString &name, const QString &tool_tip = QString());
+
+    int count() const;
+    QString name(int class_id) const;
+    QString tool_tip(int class_id) const;
+    QStringList names() const;
+    int find(const QString &name) const;
+    int find_mask_file(const QString &mask_file, const QString &img_file) const;
+
+private:
+    QVector<QString> _names;
+    QVector<QString> _tool_tips;
+    QHash<QString, int> _ids;
+};
+
+#endif
@@ -0,0 +1,360 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "MaskComponents.h"
+
+#include <QFile>
+#include <QRunnable>
+#include <QBitArray>
+#include <QMetaObject>
+
+#include "defines.h"
+#include "MaskIndex.h"
+
+
+namespace
+{
+    // root of a label with path halving .. the roots are always the
+    // smallest label of their set
+    inline int find_root(int *parent, int i)
+    {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    inline int unite(int *parent, int a, int b)
+    {
+        a = find_root(parent, a);
+        b = find_root(parent, b);
+        if (a < b) {
+            parent[b] = a;
+            return a;
+        }
+        parent[a] = b;
+        return b;
+    }
+
+    // statistics of one component while it is collected
+    class ComponentAcc
+    {
+    public:
+        int min_x, min_y, max_x, max_y;
+        int area;
+        int confident_area;
+    };
+}
+
+
+// ========== MaskComponentTask ==========
+
+// labels all class masks of one image .. the results are sent back to the
+// extractor with queued calls
+class MaskComponentTask : public QRunnable
+{
+public:
+    MaskComponentTask(MaskComponentExtractor *extractor, int run, const QString &root_dir, const QString &image)
+        : _extractor(extractor), _run(run), _root_dir(root_dir), _image(image) {}
+
+    void run()
+    {
+        QString dir = _root_dir + _image.section('/', 0, -2) + "/";
+        QString file = _image.section('/', -1);
+        for (int i = 0; i < _extractor->_class_names.size(); ++i) {
+            if (_extractor->_abort)
+                return;
+
+            MaskComponentList components;
+            QString mask_file = dir + MaskIndex::mask_file_name(file, _extractor->_class_names[i]);
+            if (QFile::exists(mask_file))
+                components = MaskLabeler::label(QImage(mask_file));
+
+            QMetaObject::invokeMethod(_extractor, "slot_mask_done_i", Qt::QueuedConnection,
+                Q_ARG(int, _run), Q_ARG(QString, _image), Q_ARG(int, i), Q_ARG(MaskComponentList, components));
+        }
+    }
+
+private:
+    MaskComponentExtractor *_extractor;
+    int _run;
+    QString _root_dir;
+    QString _image;
+};
+
+
+// ========== MaskComponent ==========
+
+MaskComponent::MaskComponent()
+{
+    area = 0;
+    confident_area = 0;
+}
+
+
+// ========== MaskLabeler ==========
+
+MaskComponentList MaskLabeler::label(const QImage &mask)
+{
+    MaskComponentList components;
+    QImage indexed = MaskIndex::to_indexed_mask(mask);
+    if (!indexed.isNull())
+        label_i(indexed, indexed.rect(), components);
+    return components;
+}
+
+QRect MaskLabeler::relabel(const QImage &mask, const QRect &dirty, MaskComponentList &components)
+{
+    // relabel only the part of the mask that a stroke touched .. the region
+    // is grown by the boxes of all components that touch it, so that no
+    // component can cross its border afterwards
+    QImage indexed = MaskIndex::to_indexed_mask(mask);
+    QRect region = dirty.adjusted(-1, -1, 1, 1) & indexed.rect();
+    if (region.isEmpty())
+        return region;
+
+    QBitArray removed(components.size());
+    bool grown = true;
+    while (grown) {
+        grown = false;
+        QRect touching = region.adjusted(-1, -1, 1, 1);
+        for (int i = 0; i < components.size(); ++i) {
+            if (removed.testBit(i) || !components[i].box.intersects(touching))
+                continue;
+
+            removed.setBit(i);
+            region |= components[i].box;
+            grown = true;
+        }
+    }
+
+    // drop the old components of the region and label it again
+    int kept = 0;
+    for (int i = 0; i < components.size(); ++i) {
+        if (!removed.testBit(i))
+            components[kept++] = components[i];
+    }
+    components.resize(kept);
+    label_i(indexed, region, components);
+
+    return region;
+}
+
+void MaskLabeler::label_i(const QImage &indexed, const QRect &roi, MaskComponentList &components)
+{
+    const int width = roi.width();
+    const int height = roi.height();
+    if (width <= 0 || height <= 0)
+        return;
+
+    // first pass: provisional labels, equivalences are merged on the fly ..
+    // label 0 is the background
+    QVector<int> labels(width * height);
+    QVector<int> parent;
+    parent.reserve(1024);
+    parent << 0;
+    for (int y = 0; y < height; ++y) {
+        const uchar *line = indexed.constScanLine(roi.top() + y) + roi.left();
+        int *row = labels.data() + y * width;
+        const int *prev = y > 0 ? row - width : NULL;
+        for (int x = 0; x < width; ++x) {
+            if (line[x] == BACKGROUND) {
+                row[x] = 0;
+                continue;
+            }
+
+            // neighbours that are already labeled: W, NW, N, NE
+            int l = x > 0 ? row[x - 1] : 0;
+            if (prev) {
+                int *p = parent.data();
+                const int neighbours[3] = { x > 0 ? prev[x - 1] : 0, prev[x], x + 1 < width ? prev[x + 1] : 0 };
+                for (int n = 0; n < 3; ++n) {
+                    if (neighbours[n] == 0)
+                        continue;
+                    l = (l == 0) ? neighbours[n] : unite(p, l, neighbours[n]);
+                }
+            }
+            if (l == 0) {
+                l = parent.size();
+                parent << l;
+            }
+            row[x] = l;
+        }
+    }
+
+    // flatten the equivalences .. roots are the smallest labels, so one pass
+    // in increasing order is enough
+    int *p = parent.data();
+    for (int i = 1; i < parent.size(); ++i)
+        p[i] = p[p[i]];
+
+    // second pass: collect the statistics per root
+    QVector<int> component_of(parent.size(), -1);
+    QVector<ComponentAcc> accs;
+    for (int y = 0; y < height; ++y) {
+        const uchar *line = indexed.constScanLine(roi.top() + y) + roi.left();
+        const int *row = labels.constData() + y * width;
+        for (int x = 0; x < width; ++x) {
+            if (row[x] == 0)
+                continue;
+
+            int root = p[row[x]];
+            int c = component_of[root];
+            if (c < 0) {
+                ComponentAcc acc;
+                acc.min_x = acc.max_x = x;
+                acc.min_y = acc.max_y = y;
+                acc.area = 0;
+                acc.confident_area = 0;
+                c = component_of[root] = accs.size();
+                accs << acc;
+            }
+
+            ComponentAcc &acc = accs[c];
+            acc.min_x = MIN(acc.min_x, x);
+            acc.max_x = MAX(acc.max_x, x);
+            acc.max_y = y;
+            acc.area++;
+            if (line[x] == CONFIDENCE_OBJECT)
+                acc.confident_area++;
+        }
+    }
+
+    components.reserve(components.size() + accs.size());
+    for (int i = 0; i < accs.size(); ++i) {
+        MaskComponent component;
+        component.box = QRect(QPoint(roi.left() + accs[i].min_x, roi.top() + accs[i].min_y),
+            QPoint(roi.left() + accs[i].max_x, roi.top() + accs[i].max_y));
+        component.area = accs[i].area;
+        component.confident_area = accs[i].confident_area;
+        components << component;
+    }
+}
+
+IAObj MaskLabeler::to_object(const MaskComponent &component, const QString &type)
+{
+    // the box covers the pixels completely .. the score is the share of
+    // confidently labeled pixels
+    IAObj obj;
+    obj.type = type;
+    obj.box = QRectF(component.box);
+    obj.score = component.area > 0 ? double(component.confident_area) / component.area : 0.0;
+    return obj;
+}
+
+void MaskLabeler::apply(ImgAnnotation *annotation, const QString &image, const QString &type, const MaskComponentList &components)
+{
+    // replace the objects of the given type in the image's entry .. objects
+    // that still match a component are kept, so after a relabel only the
+    // components of the touched region are removed and added again
+    IAFileHandle handle = annotation->fileHandle(image.section('/', 0, -2), image.section('/', -1));
+    if (handle == IA_INVALID_HANDLE && components.isEmpty())
+        return;
+    if (handle == IA_INVALID_HANDLE)
+        handle = annotation->createFile(image.section('/', 0, -2), image.section('/', -1));
+
+    // relabel keeps the untouched components in order and appends the new
+    // ones, so the objects are matched against the components in order
+    const int type_id = IAStringPool::intern(type);
+    const QVector<IAObj> &objects = *annotation->getObj(handle);
+    QList<int> old_objects;
+    int matched = 0;
+    for (int i = 0; i < objects.size(); ++i) {
+        if (objects[i].type.id != type_id)
+            continue;
+        if (matched < components.size()) {
+            IAObj obj = to_object(components[matched], type);
+            if (objects[i].box == obj.box && objects[i].score == obj.score) {
+                matched++;
+                continue;
+            }
+        }
+        old_objects << i;
+    }
+    annotation->removeObjs(handle, old_objects);
+
+    QList<IAObj> new_objects;
+    new_objects.reserve(components.size() - matched);
+    for (int i = matched; i < components.size(); ++i)
+        new_objects << to_object(components[i], type);
+    annotation->newObjs(handle, new_objects);
+}
+
+
+// ========== MaskComponentExtractor ==========
+
+MaskComponentExtractor::MaskComponentExtractor(ImgAnnotation *annotation, QObject *parent)
+    : QObject(parent)
+{
+    qRegisterMetaType<MaskComponentList>("MaskComponentList");
+    _annotation = annotation;
+    _run = 0;
+    _done = 0;
+    _total = 0;
+    _abort = false;
+}
+
+MaskComponentExtractor::~MaskComponentExtractor()
+{
+    cancel();
+}
+
+void MaskComponentExtractor::start(const QString &root_dir, const QStringList &images, const QStringList &class_names)
+{
+    cancel();
+
+    // results of earlier runs that are still queued are ignored
+    _run++;
+    _abort = false;
+    _class_names = class_names;
+    _done = 0;
+    _total = images.size() * class_names.size();
+    for (int i = 0; i < images.size(); ++i)
+        _pool.start(new MaskComponentTask(this, _run, root_dir, images[i]));
+
+    if (_total == 0)
+        emit finished();
+}
+
+void MaskComponentExtractor::cancel()
+{
+    _abort = true;
+    _pool.waitForDone();
+}
+
+bool MaskComponentExtractor::is_running() const
+{
+    return _done < _total && !_abort;
+}
+
+void MaskComponentExtractor::slot_mask_done_i(int run, const QString &image, int class_id, const MaskComponentList &components)
+{
+    if (run != _run || _abort)
+        return;
+
+    MaskLabeler::apply(_annotation, image, _class_names[class_id], components);
+
+    _done++;
+    emit progress(_done, _total);
+    if (_done == _total)
+        emit finished();
+}
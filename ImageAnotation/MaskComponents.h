@@ -0,0 +1,99 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef MaskComponents_H
+#define MaskComponents_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QRect>
+#include <QImage>
+#include <QMetaType>
+#include <QThreadPool>
+#include "ImgAnnotation.h"
+
+// a connected region (8-neighbourhood) of object pixels in a class mask
+class MaskComponent
+{
+public:
+    MaskComponent();
+
+public:
+    QRect box;
+    int area;
+    int confident_area;
+};
+Q_DECLARE_TYPEINFO(MaskComponent, Q_MOVABLE_TYPE);
+
+typedef QVector<MaskComponent> MaskComponentList;
+Q_DECLARE_METATYPE(MaskComponentList)
+
+
+// two pass union-find labeling of masks
+class MaskLabeler
+{
+public:
+    static MaskComponentList label(const QImage &mask);
+    static QRect relabel(const QImage &mask, const QRect &dirty, MaskComponentList &components);
+    static IAObj to_object(const MaskComponent &component, const QString &type);
+    static void apply(ImgAnnotation *annotation, const QString &image, const QString &type, const MaskComponentList &components);
+
+private:
+    static void label_i(const QImage &indexed, const QRect &roi, MaskComponentList &components);
+};
+
+
+// extracts the components of all class masks of a set of images on a thread
+// pool and stores them as objects in an ImgAnnotation
+class MaskComponentExtractor : public QObject
+{
+    Q_OBJECT
+
+public:
+    MaskComponentExtractor(ImgAnnotation *annotation, QObject *parent = 0);
+    virtual ~MaskComponentExtractor();
+
+    void start(const QString &root_dir, const QStringList &images, const QStringList &class_names);
+    void cancel();
+    bool is_running() const;
+
+signals:
+    void progress(int done, int total);
+    void finished();
+
+private slots:
+    void slot_mask_done_i(int run, const QString &image, int class_id, const MaskComponentList &components);
+
+private:
+    friend class MaskComponentTask;
+
+    ImgAnnotation *_annotation;
+    QThreadPool _pool;
+    QStringList _class_names;
+    int _run;
+    int _done;
+    int _total;
+    volatile bool _abort;
+};
+
+#endif
@@ -0,0 +1,337 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "MaskContours.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QHash>
+#include <QPair>
+#include <math.h>
+
+#include "defines.h"
+
+
+namespace
+{
+    // samples the object pixels of a mask .. indexed masks are compared to
+    // the background index, 32 bit masks (the drawing mask) to zero
+    class MaskSampler
+    {
+    public:
+        MaskSampler(const QImage &mask)
+        {
+            if (mask.format() == QImage::Format_Indexed8 || mask.depth() == 32)
+                _mask = mask;
+            else
+                _mask = mask.convertToFormat(QImage::Format_ARGB32);
+            _indexed = (_mask.format() == QImage::Format_Indexed8);
+        }
+
+        inline bool object(int x, int y) const
+        {
+            if (x < 0 || y < 0 || x >= _mask.width() || y >= _mask.height())
+                return false;
+            if (_indexed)
+                return _mask.constScanLine(y)[x] != BACKGROUND;
+            return reinterpret_cast<const QRgb *>(_mask.constScanLine(y))[x] != 0;
+        }
+
+    private:
+        QImage _mask;
+        bool _indexed;
+    };
+
+    // contour points are edge midpoints between pixel centers .. they are
+    // kept as doubled integer coordinates while the segments are chained
+    inline qint64 point_key(int x2, int y2)
+    {
+        return (qint64(x2 + 4) << 32) | quint32(y2 + 4);
+    }
+
+    inline QPointF key_point(qint64 key)
+    {
+        return QPointF(0.5 * (int(key >> 32) - 4), 0.5 * (int(key & 0xffffffff) - 4));
+    }
+
+    // squared distance of p to the segment a-b
+    double segment_distance2(const QPointF &p, const QPointF &a, const QPointF &b)
+    {
+        double dx = b.x() - a.x(), dy = b.y() - a.y();
+        double len2 = dx * dx + dy * dy;
+        double t = len2 > 0 ? ((p.x() - a.x()) * dx + (p.y() - a.y()) * dy) / len2 : 0.0;
+        t = t < 0 ? 0 : (t > 1 ? 1 : t);
+        double ex = a.x() + t * dx - p.x(), ey = a.y() + t * dy - p.y();
+        return ex * ex + ey * ey;
+    }
+
+    // douglas-peucker on points[first..last], the end points are kept
+    void simplify(const QPolygonF &points, int first, int last, double tolerance2, QVector<bool> &keep)
+    {
+        QVector<QPair<int, int> > stack;
+        stack << qMakePair(first, last);
+        while (!stack.isEmpty()) {
+            QPair<int, int> range = stack.last();
+            stack.pop_back();
+
+            double max_dist = 0;
+            int max_index = -1;
+            for (int i = range.first + 1; i < range.second; ++i) {
+                double d = segment_distance2(points[i], points[range.first], points[range.second]);
+                if (d > max_dist) {
+                    max_dist = d;
+                    max_index = i;
+                }
+            }
+            if (max_index >= 0 && max_dist > tolerance2) {
+                keep[max_index] = true;
+                stack << qMakePair(range.first, max_index) << qMakePair(max_index, range.second);
+            }
+        }
+    }
+
+    QPolygonF simplified(const QPolygonF &points, double tolerance)
+    {
+        if (points.size() <= 2 || tolerance <= 0)
+            return points;
+
+        QVector<bool> keep(points.size(), false);
+        keep[0] = true;
+        keep[points.size() - 1] = true;
+        if (points.first() == points.last()) {
+            // closed loops are split at the point farthest from the start
+            int far_index = 1;
+            double far_dist = 0;
+            for (int i = 1; i < points.size() - 1; ++i) {
+                QPointF d = points[i] - points[0];
+                double dist = d.x() * d.x() + d.y() * d.y();
+                if (dist > far_dist) {
+                    far_dist = dist;
+                    far_index = i;
+                }
+            }
+            keep[far_index] = true;
+            simplify(points, 0, far_index, tolerance * tolerance, keep);
+            simplify(points, far_index, points.size() - 1, tolerance * tolerance, keep);
+        }
+        else {
+            simplify(points, 0, points.size() - 1, tolerance * tolerance, keep);
+        }
+
+        QPolygonF result;
+        for (int i = 0; i < points.size(); ++i) {
+            if (keep[i])
+                result << points[i];
+        }
+        return result;
+    }
+}
+
+
+// ========== MaskContours ==========
+
+MaskContours::MaskContours()
+{
+    _tiles_x = 0;
+    _tiles_y = 0;
+}
+
+void MaskContours::reset(const QSize &mask_size)
+{
+    // there is one marching squares cell more than pixels in each direction,
+    // so that the contours of border pixels are closed
+    _mask_size = mask_size;
+    _tiles_x = (mask_size.width() + MASK_CONTOUR_TILE_SIZE) / MASK_CONTOUR_TILE_SIZE;
+    _tiles_y = (mask_size.height() + MASK_CONTOUR_TILE_SIZE) / MASK_CONTOUR_TILE_SIZE;
+    _tiles.clear();
+    _tiles.resize(_tiles_x * _tiles_y);
+}
+
+qint64 MaskContours::byte_count() const
+{
+    // the points of all cached polylines and the tiles themselves
+    qint64 bytes = qint64(_tiles.size()) * sizeof(Tile);
+    for (int i = 0; i < _tiles.size(); ++i) {
+        const QVector<QPolygonF> &polylines = _tiles[i].polylines;
+        for (int j = 0; j < polylines.size(); ++j)
+            bytes += qint64(polylines[j].size()) * sizeof(QPointF);
+    }
+    return bytes;
+}
+
+void MaskContours::invalidate(const QRect &dirty)
+{
+    // a pixel is a corner of the cells with top left sample x-1..x, y-1..y,
+    // i.e., of the cell columns x..x+1 (columns are shifted by one)
+    if (dirty.isEmpty() || _tiles.isEmpty())
+        return;
+
+    int tx0 = qBound(0, dirty.left() / MASK_CONTOUR_TILE_SIZE, _tiles_x - 1);
+    int tx1 = qBound(0, (dirty.right() + 1) / MASK_CONTOUR_TILE_SIZE, _tiles_x - 1);
+    int ty0 = qBound(0, dirty.top() / MASK_CONTOUR_TILE_SIZE, _tiles_y - 1);
+    int ty1 = qBound(0, (dirty.bottom() + 1) / MASK_CONTOUR_TILE_SIZE, _tiles_y - 1);
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            Tile &tile = _tiles[ty * _tiles_x + tx];
+            tile.valid = false;
+            tile.polylines.clear();
+        }
+    }
+}
+
+QRect MaskContours::tile_cells_i(int tile_x, int tile_y) const
+{
+    // cells are addressed by their top left sample, which goes from -1 to
+    // width-1 (height-1 resp.)
+    int x0 = tile_x * MASK_CONTOUR_TILE_SIZE - 1;
+    int y0 = tile_y * MASK_CONTOUR_TILE_SIZE - 1;
+    int x1 = qMin(x0 + MASK_CONTOUR_TILE_SIZE, _mask_size.width()) - 1;
+    int y1 = qMin(y0 + MASK_CONTOUR_TILE_SIZE, _mask_size.height()) - 1;
+    return QRect(QPoint(x0, y0), QPoint(x1, y1));
+}
+
+void MaskContours::polylines(const QImage &mask, const QRectF &visible, QVector<const QPolygonF *> &result)
+{
+    result.clear();
+    if (mask.size() != _mask_size)
+        reset(mask.size());
+    if (_tiles.isEmpty())
+        return;
+
+    // the points of cell x lie within x+0.5 .. x+1.5
+    int tx0 = qBound(0, int(floor(visible.left() - 1.5)) + 1, _mask_size.width()) / MASK_CONTOUR_TILE_SIZE;
+    int tx1 = qBound(0, int(ceil(visible.right() - 0.5)) + 1, _mask_size.width()) / MASK_CONTOUR_TILE_SIZE;
+    int ty0 = qBound(0, int(floor(visible.top() - 1.5)) + 1, _mask_size.height()) / MASK_CONTOUR_TILE_SIZE;
+    int ty1 = qBound(0, int(ceil(visible.bottom() - 0.5)) + 1, _mask_size.height()) / MASK_CONTOUR_TILE_SIZE;
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            Tile &tile = _tiles[ty * _tiles_x + tx];
+            if (!tile.valid) {
+                tile.polylines = trace(mask, tile_cells_i(tx, ty));
+                tile.valid = true;
+            }
+            for (int i = 0; i < tile.polylines.size(); ++i)
+                result << &tile.polylines[i];
+        }
+    }
+}
+
+QVector<QPolygonF> MaskContours::trace(const QImage &mask, const QRect &cells, double tolerance)
+{
+    // marching squares over the given cells .. corners are numbered
+    // tl = 1, tr = 2, br = 4, bl = 8; saddles are resolved such that
+    // diagonal object pixels stay connected (as for the labeling)
+    static const int edges[16][4] = {
+        { -1, -1, -1, -1 }, { 3, 0, -1, -1 }, { 0, 1, -1, -1 }, { 3, 1, -1, -1 },
+        { 1, 2, -1, -1 }, { 0, 1, 2, 3 }, { 0, 2, -1, -1 }, { 3, 2, -1, -1 },
+        { 2, 3, -1, -1 }, { 0, 2, -1, -1 }, { 3, 0, 1, 2 }, { 1, 2, -1, -1 },
+        { 3, 1, -1, -1 }, { 0, 1, -1, -1 }, { 3, 0, -1, -1 }, { -1, -1, -1, -1 }
+    };
+
+    MaskSampler sampler(mask);
+    QVector<QPair<qint64, qint64> > segments;
+    for (int y = cells.top(); y <= cells.bottom(); ++y) {
+        for (int x = cells.left(); x <= cells.right(); ++x) {
+            int code = (sampler.object(x, y) ? 1 : 0) | (sampler.object(x + 1, y) ? 2 : 0)
+                | (sampler.object(x + 1, y + 1) ? 4 : 0) | (sampler.object(x, y + 1) ? 8 : 0);
+            if (code == 0 || code == 15)
+                continue;
+
+            // edge midpoints: top, right, bottom, left (doubled coordinates)
+            const qint64 keys[4] = {
+                point_key(2 * x + 2, 2 * y + 1), point_key(2 * x + 3, 2 * y + 2),
+                point_key(2 * x + 2, 2 * y + 3), point_key(2 * x + 1, 2 * y + 2)
+            };
+            for (int i = 0; i < 4 && edges[code][i] >= 0; i += 2)
+                segments << qMakePair(keys[edges[code][i]], keys[edges[code][i + 1]]);
+        }
+    }
+
+    // chain the segments .. each point has one or two segments, points with
+    // one segment are the open ends at the border of the cells
+    QHash<qint64, QPair<int, int> > point_segments;
+    point_segments.reserve(2 * segments.size());
+    for (int i = 0; i < segments.size(); ++i) {
+        const qint64 ends[2] = { segments[i].first, segments[i].second };
+        for (int j = 0; j < 2; ++j) {
+            QHash<qint64, QPair<int, int> >::iterator it = point_segments.find(ends[j]);
+            if (it == point_segments.end())
+                point_segments.insert(ends[j], qMakePair(i, -1));
+            else
+                it.value().second = i;
+        }
+    }
+
+    QVector<QPolygonF> result;
+    QVector<bool> used(segments.size(), false);
+    for (int pass = 0; pass < 2; ++pass) {
+        // first the open polylines, then the closed loops
+        for (QHash<qint64, QPair<int, int> >::const_iterator it = point_segments.constBegin(); it != point_segments.constEnd(); ++it) {
+            if (pass == 0 && it.value().second >= 0)
+                continue;
+
+            qint64 current = it.key();
+            int segment = used[it.value().first] ? it.value().second : it.value().first;
+            if (segment < 0 || used[segment])
+                continue;
+
+            QPolygonF polyline;
+            polyline << key_point(current);
+            while (segment >= 0 && !used[segment]) {
+                used[segment] = true;
+                current = (segments[segment].first == current) ? segments[segment].second : segments[segment].first;
+                polyline << key_point(current);
+
+                QPair<int, int> next = point_segments.value(current);
+                segment = (next.first == segment) ? next.second : next.first;
+            }
+            result << simplified(polyline, tolerance);
+        }
+    }
+    return result;
+}
+
+bool MaskContours::save_svg(const QImage &mask, const QString &file_name, double tolerance)
+{
+    // the whole mask in one go, so that all outlines are closed
+    QVector<QPolygonF> polylines = trace(mask, QRect(QPoint(-1, -1), QPoint(mask.width() - 1, mask.height() - 1)), tolerance);
+
+    QFile file(file_name);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QTextStream out(&file);
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    out << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << mask.width() << "\" height=\"" << mask.height()
+        << "\" viewBox=\"0 0 " << mask.width() << " " << mask.height() << "\">\n";
+    out << "<path fill=\"none\" stroke=\"red\" d=\"";
+    for (int i = 0; i < polylines.size(); ++i) {
+        const QPolygonF &polyline = polylines[i];
+        bool closed = polyline.size() > 2 && polyline.first() == polyline.last();
+        int count = closed ? polyline.size() - 1 : polyline.size();
+        for (int j = 0; j < count; ++j)
+            out << (j == 0 ? "M" : " L") << polyline[j].x() << " " << polyline[j].y();
+        out << (closed ? "Z" : "") << "\n";
+    }
+    out << "\"/>\n</svg>\n";
+
+    return out.status() == QTextStream::Ok;
+}
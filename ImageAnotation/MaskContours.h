@@ -0,0 +1,76 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef MaskContours_H
+#define MaskContours_H
+
+#include <QString>
+#include <QVector>
+#include <QRect>
+#include <QRectF>
+#include <QSize>
+#include <QImage>
+#include <QPolygonF>
+
+// maximal distance (in pixels) of a simplified contour to the traced one
+#define MASK_CONTOUR_TOLERANCE 0.5
+
+// edge length of the tiles (in marching squares cells) the contours are
+// cached in
+#define MASK_CONTOUR_TILE_SIZE 64
+
+
+// outlines of the object pixels of a mask .. traced with marching squares
+// and simplified, cached per tile and retraced only for tiles that have
+// been invalidated
+class MaskContours
+{
+public:
+    MaskContours();
+
+    void reset(const QSize &mask_size);
+    void invalidate(const QRect &dirty);
+    void polylines(const QImage &mask, const QRectF &visible, QVector<const QPolygonF *> &result);
+    qint64 byte_count() const;
+
+    static QVector<QPolygonF> trace(const QImage &mask, const QRect &cells, double tolerance = MASK_CONTOUR_TOLERANCE);
+    static bool save_svg(const QImage &mask, const QString &file_name, double tolerance = MASK_CONTOUR_TOLERANCE);
+
+private:
+    class Tile
+    {
+    public:
+        Tile() : valid(false) {}
+
+        bool valid;
+        QVector<QPolygonF> polylines;
+    };
+
+    QRect tile_cells_i(int tile_x, int tile_y) const;
+
+private:
+    QSize _mask_size;
+    int _tiles_x;
+    int _tiles_y;
+    QVector<Tile> _tiles;
+};
+
+#endif
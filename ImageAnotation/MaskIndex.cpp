@@ -0,0 +1,487 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "MaskIndex.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QMutexLocker>
+#include <QSet>
+#include <QtDebug>
+
+#include "defines.h"
+#include "AtomicFile.h"
+
+#define MASK_INDEX_FILE "/.annotation_index"
+#define MASK_INDEX_MAGIC 0x4d534b49
+#define MASK_INDEX_VERSION 1
+
+
+// ========== MaskIndexScanner ==========
+
+// background thread that brings the index up to date with the mask files
+class MaskIndexScanner : public QThread
+{
+public:
+    MaskIndexScanner(MaskIndex *index) : _index(index) {}
+
+protected:
+    void run() { _index->scan_i(); }
+
+private:
+    MaskIndex *_index;
+};
+
+
+// ========== MaskClassInfo ==========
+
+MaskClassInfo::MaskClassInfo()
+{
+    exists = false;
+    confident_pixels = 0;
+    unconfident_pixels = 0;
+    mtime = 0;
+}
+
+bool MaskClassInfo::has_labels() const
+{
+    return exists && (confident_pixels > 0 || unconfident_pixels > 0);
+}
+
+QDataStream &operator<<(QDataStream &out, const MaskClassInfo &info)
+{
+    out << info.exists << qint32(info.confident_pixels) << qint32(info.unconfident_pixels) << info.box << info.mtime;
+    return out;
+}
+
+QDataStream &operator>>(QDataStream &in, MaskClassInfo &info)
+{
+    qint32 confident, unconfident;
+    in >> info.exists >> confident >> unconfident >> info.box >> info.mtime;
+    info.confident_pixels = confident;
+    info.unconfident_pixels = unconfident;
+    // the write was still pending when the index was saved .. the file is
+    // read again
+    if (info.mtime == MASK_MTIME_PENDING)
+        info.mtime = 0;
+    return in;
+}
+
+
+// ========== MaskIndex ==========
+
+MaskIndex::MaskIndex(QObject *parent)
+    : QObject(parent)
+{
+    _is_dirty = false;
+    _scanner = NULL;
+    _abort_scan = false;
+    _scan_running = false;
+}
+
+MaskIndex::~MaskIndex()
+{
+    close();
+}
+
+QString MaskIndex::mask_file_name(QString img_file, const QString &class_name)
+{
+    // mask file name looks like: <imageFileName without extension>.mask.<class name>.png
+    return mask_file_prefix(img_file) + class_name + ".png";
+}
+
+QString MaskIndex::mask_file_prefix(QString img_file)
+{
+    // the part of the mask file names which is the same for all classes
+    return img_file.replace(".image.", ".").section(".", 0, -2) + ".mask.";
+}
+
+void MaskIndex::open(const QString &root_dir, const QStringList &images, const QStringList &class_names)
+{
+    close();
+
+    _root_dir = root_dir;
+    _class_names = class_names;
+    {
+        QMutexLocker locker(&_mutex);
+        _scan_queue = images;
+        _scan_running = true;
+    }
+
+    // start with what we know from the last session and let the scanner
+    // check the rest in the background
+    load_i();
+    prune_i(images);
+    _scanner = new MaskIndexScanner(this);
+    _scanner->start(QThread::LowPriority);
+}
+
+void MaskIndex::close()
+{
+    stop_scan_i();
+
+    if (_is_dirty)
+        save();
+
+    QMutexLocker locker(&_mutex);
+    _entries.clear();
+    _scan_queue.clear();
+    _scan_running = false;
+    _root_dir.clear();
+    _is_dirty = false;
+}
+
+bool MaskIndex::save()
+{
+    QMutexLocker locker(&_mutex);
+    if (_root_dir.isEmpty())
+        return false;
+
+    // write to a temporary file first .. a crash should never leave a broken index behind
+    QString filepath = index_file_i();
+    QFile file(AtomicFile::temp_name(filepath));
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_7);
+    out << quint32(MASK_INDEX_MAGIC) << quint32(MASK_INDEX_VERSION);
+    out << _class_names;
+    out << quint32(_entries.size());
+    for (QHash<QString, MaskImageInfo>::const_iterator i = _entries.constBegin(); i != _entries.constEnd(); ++i)
+        out << i.key() << i.value().classes;
+    if (out.status() != QDataStream::Ok) {
+        file.close();
+        file.remove();
+        return false;
+    }
+    if (!AtomicFile::commit(file, filepath))
+        return false;
+
+    _is_dirty = false;
+    return true;
+}
+
+bool MaskIndex::is_scanning() const
+{
+    return _scanner && _scanner->isRunning();
+}
+
+bool MaskIndex::contains(const QString &image) const
+{
+    QMutexLocker locker(&_mutex);
+    return _entries.contains(image);
+}
+
+MaskClassInfo MaskIndex::info(const QString &image, int class_id) const
+{
+    QMutexLocker locker(&_mutex);
+    QHash<QString, MaskImageInfo>::const_iterator i = _entries.constFind(image);
+    if (i == _entries.constEnd() || class_id < 0 || class_id >= i.value().classes.size())
+        return MaskClassInfo();
+
+    return i.value().classes[class_id];
+}
+
+bool MaskIndex::has_labels(const QString &image, int class_id) const
+{
+    return info(image, class_id).has_labels();
+}
+
+void MaskIndex::update_mask(const QString &image, int class_id, const QImage &mask)
+{
+    if (class_id < 0 || class_id >= _class_names.size())
+        return;
+
+    // the mask is written by us in the background .. take the numbers from
+    // memory, the mtime follows with update_mtime() once it is on disk
+    MaskClassInfo info;
+    count_pixels_i(mask, info);
+    info.exists = true;
+    info.mtime = MASK_MTIME_PENDING;
+
+    {
+        QMutexLocker locker(&_mutex);
+        MaskImageInfo &entry = _entries[image];
+        entry.classes.resize(_class_names.size());
+        entry.classes[class_id] = info;
+        _is_dirty = true;
+    }
+
+    emit image_indexed(image);
+}
+
+void MaskIndex::update_mtime(const QString &image, int class_id)
+{
+    if (class_id < 0 || class_id >= _class_names.size())
+        return;
+
+    QFileInfo fileInfo(_root_dir + image.section('/', 0, -2) + "/" + mask_file_name(image.section('/', -1), _class_names[class_id]));
+    QMutexLocker locker(&_mutex);
+    QHash<QString, MaskImageInfo>::iterator i = _entries.find(image);
+    if (i == _entries.end() || class_id >= i.value().classes.size())
+        return;
+
+    MaskClassInfo &info = i.value().classes[class_id];
+    info.exists = fileInfo.exists();
+    info.mtime = info.exists ? fileInfo.lastModified().toMSecsSinceEpoch() : 0;
+    _is_dirty = true;
+}
+
+QString MaskIndex::index_file_i() const
+{
+    return _root_dir + MASK_INDEX_FILE;
+}
+
+bool MaskIndex::load_i()
+{
+    QFile file(index_file_i());
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_7);
+    quint32 magic, version, count;
+    in >> magic >> version;
+    if (magic != MASK_INDEX_MAGIC || version != MASK_INDEX_VERSION)
+        return false;
+
+    // the class list might have changed since the index was written .. map the
+    // stored classes onto the current ones by their names
+    QStringList storedClasses;
+    in >> storedClasses;
+    QVector<int> classMap(storedClasses.size());
+    for (int i = 0; i < storedClasses.size(); i++)
+        classMap[i] = _class_names.indexOf(storedClasses[i]);
+
+    QHash<QString, MaskImageInfo> entries;
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QString image;
+        QVector<MaskClassInfo> classes;
+        in >> image >> classes;
+
+        MaskImageInfo &entry = entries[image];
+        entry.classes.resize(_class_names.size());
+        for (int j = 0; j < classes.size() && j < classMap.size(); j++) {
+            if (classMap[j] >= 0)
+                entry.classes[classMap[j]] = classes[j];
+        }
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "MaskIndex: ignoring corrupt index file" << file.fileName();
+        return false;
+    }
+
+    QMutexLocker locker(&_mutex);
+    _entries = entries;
+    _is_dirty = false;
+    return true;
+}
+
+void MaskIndex::prune_i(const QStringList &images)
+{
+    // images which are gone (or belong to another data set under the same
+    // root) are dropped .. otherwise the index would only ever grow
+    QSet<QString> known = images.toSet();
+    QMutexLocker locker(&_mutex);
+    QHash<QString, MaskImageInfo>::iterator i = _entries.begin();
+    while (i != _entries.end()) {
+        if (known.contains(i.key())) {
+            ++i;
+            continue;
+        }
+        i = _entries.erase(i);
+        _is_dirty = true;
+    }
+}
+
+void MaskIndex::scan_i()
+{
+    while (!_abort_scan) {
+        QString image;
+        MaskImageInfo entry;
+        bool known;
+        {
+            QMutexLocker locker(&_mutex);
+            if (_scan_queue.isEmpty()) {
+                _scan_running = false;
+                break;
+            }
+            image = _scan_queue.takeFirst();
+            known = _entries.contains(image);
+            entry = _entries.value(image);
+        }
+        entry.classes.resize(_class_names.size());
+
+        // only open the masks whose file changed since we have seen them last
+        QVector<int> changedClasses;
+        QString dir = image.section('/', 0, -2);
+        QString filename = image.section('/', -1);
+        for (int j = 0; j < _class_names.size(); j++) {
+            QFileInfo fileInfo(_root_dir + dir + "/" + mask_file_name(filename, _class_names[j]));
+            bool exists = fileInfo.exists();
+            qint64 mtime = exists ? fileInfo.lastModified().toMSecsSinceEpoch() : 0;
+            if (exists == entry.classes[j].exists && mtime == entry.classes[j].mtime)
+                continue;
+            // our own write is on its way .. the file still has the old mask
+            if (entry.classes[j].mtime == MASK_MTIME_PENDING)
+                continue;
+
+            entry.classes[j] = read_mask_i(image, j);
+            changedClasses << j;
+        }
+
+        if (known && changedClasses.isEmpty())
+            continue;
+
+        {
+            // merge class by class .. the user might have saved a mask meanwhile
+            QMutexLocker locker(&_mutex);
+            MaskImageInfo &stored = _entries[image];
+            stored.classes.resize(_class_names.size());
+            for (int j = 0; j < changedClasses.size(); j++)
+                stored.classes[changedClasses[j]] = entry.classes[changedClasses[j]];
+            _is_dirty = true;
+        }
+
+        emit image_indexed(image);
+    }
+
+    if (!_abort_scan) {
+        save();
+        emit scan_finished();
+    }
+}
+
+void MaskIndex::update_images(const QStringList &removed, const QStringList &changed)
+{
+    {
+        QMutexLocker locker(&_mutex);
+        if (_root_dir.isEmpty())
+            return;
+
+        for (int i = 0; i < removed.size(); i++) {
+            _entries.remove(removed[i]);
+            _scan_queue.removeAll(removed[i]);
+        }
+        if (!removed.isEmpty())
+            _is_dirty = true;
+
+        // new images and images with changed mask files are checked by the
+        // scanner .. a running one simply picks them up
+        _scan_queue += changed;
+        if (_scan_running || changed.isEmpty())
+            return;
+        _scan_running = true;
+    }
+
+    // the last scanner has finished (or is just about to)
+    if (_scanner) {
+        _scanner->wait();
+        delete _scanner;
+    }
+    _scanner = new MaskIndexScanner(this);
+    _scanner->start(QThread::LowPriority);
+}
+
+void MaskIndex::stop_scan_i()
+{
+    if (!_scanner)
+        return;
+
+    _abort_scan = true;
+    _scanner->wait();
+    delete _scanner;
+    _scanner = NULL;
+    _abort_scan = false;
+}
+
+MaskClassInfo MaskIndex::read_mask_i(const QString &image, int class_id) const
+{
+    MaskClassInfo info;
+    QFileInfo fileInfo(_root_dir + image.section('/', 0, -2) + "/" + mask_file_name(image.section('/', -1), _class_names[class_id]));
+    if (!fileInfo.exists())
+        return info;
+
+    info.exists = true;
+    info.mtime = fileInfo.lastModified().toMSecsSinceEpoch();
+    count_pixels_i(QImage(fileInfo.filePath()), info);
+    return info;
+}
+
+QImage MaskIndex::to_indexed_mask(const QImage &mask)
+{
+    // saved masks are Indexed8 .. anything else is classified by its color
+    // the same way the drawing mask is converted when it is saved
+    if (mask.isNull() || mask.format() == QImage::Format_Indexed8)
+        return mask;
+
+    QImage argb = mask.convertToFormat(QImage::Format_ARGB32);
+    QImage indexed(argb.size(), QImage::Format_Indexed8);
+    for (int y = 0; y < argb.height(); ++y) {
+        const QRgb *src = reinterpret_cast<const QRgb *>(argb.constScanLine(y));
+        uchar *dst = indexed.scanLine(y);
+        for (int x = 0; x < argb.width(); ++x) {
+            if (qRed(src[x]) > 0)
+                dst[x] = CONFIDENCE_OBJECT;
+            else if (qGreen(src[x]) > 0)
+                dst[x] = UN_CONFIDENCE_OBJECT;
+            else
+                dst[x] = BACKGROUND;
+        }
+    }
+    return indexed;
+}
+
+void MaskIndex::count_pixels_i(const QImage &mask, MaskClassInfo &info)
+{
+    info.confident_pixels = 0;
+    info.unconfident_pixels = 0;
+    info.box = QRect();
+    if (mask.isNull())
+        return;
+
+    QImage indexed = to_indexed_mask(mask);
+    int minX = indexed.width(), minY = indexed.height(), maxX = -1, maxY = -1;
+    for (int y = 0; y < indexed.height(); ++y) {
+        const uchar *line = indexed.constScanLine(y);
+        for (int x = 0; x < indexed.width(); ++x) {
+            if (line[x] == CONFIDENCE_OBJECT)
+                info.confident_pixels++;
+            else if (line[x] == UN_CONFIDENCE_OBJECT)
+                info.unconfident_pixels++;
+            else
+                continue;
+
+            minX = MIN(minX, x);
+            maxX = MAX(maxX, x);
+            minY = MIN(minY, y);
+            maxY = MAX(maxY, y);
+        }
+    }
+
+    if (maxX >= 0)
+        info.box = QRect(QPoint(minX, minY), QPoint(maxX, maxY));
+}
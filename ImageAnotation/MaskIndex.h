@@ -0,0 +1,120 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef MaskIndex_H
+#define MaskIndex_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QVector>
+#include <QRect>
+#include <QImage>
+#include <QMutex>
+#include <QThread>
+
+// mtime of a mask that has been updated in memory but is not written yet
+#define MASK_MTIME_PENDING -1
+
+// summary of one class mask of one image
+class MaskClassInfo
+{
+public:
+    MaskClassInfo();
+    bool has_labels() const;
+
+public:
+    bool exists;
+    int confident_pixels;
+    int unconfident_pixels;
+    QRect box;
+    qint64 mtime;
+};
+
+// summary of all class masks of one image
+class MaskImageInfo
+{
+public:
+    QVector<MaskClassInfo> classes;
+};
+
+
+// persistent index over all masks of the opened directory structure .. it is
+// filled in the background and allows to query the annotation progress
+// without opening any mask file
+class MaskIndex : public QObject
+{
+    Q_OBJECT
+
+public:
+    MaskIndex(QObject *parent = 0);
+    virtual ~MaskIndex();
+
+    static QString mask_file_name(QString img_file, const QString &class_name);
+    static QString mask_file_prefix(QString img_file);
+    static QImage to_indexed_mask(const QImage &mask);
+
+    void open(const QString &root_dir, const QStringList &images, const QStringList &class_names);
+    void close();
+    bool save();
+
+    bool is_scanning() const;
+    bool contains(const QString &image) const;
+    MaskClassInfo info(const QString &image, int class_id) const;
+    bool has_labels(const QString &image, int class_id) const;
+    void update_mask(const QString &image, int class_id, const QImage &mask);
+    void update_images(const QStringList &removed, const QStringList &changed);
+
+public slots:
+    // takes the mtime of a mask file written after update_mask
+    void update_mtime(const QString &image, int class_id);
+
+signals:
+    void image_indexed(const QString &image);
+    void scan_finished();
+
+private:
+    friend class MaskIndexScanner;
+
+    QString index_file_i() const;
+    bool load_i();
+    void prune_i(const QStringList &images);
+    void scan_i();
+    void stop_scan_i();
+    MaskClassInfo read_mask_i(const QString &image, int class_id) const;
+    static void count_pixels_i(const QImage &mask, MaskClassInfo &info);
+
+private:
+    mutable QMutex _mutex;
+    QHash<QString, MaskImageInfo> _entries;
+    QString _root_dir;
+    // images the scanner still has to look at
+    QStringList _scan_queue;
+    bool _scan_running;
+    QStringList _class_names;
+    bool _is_dirty;
+
+    QThread *_scanner;
+    volatile bool _abort_scan;
+};
+
+#endif
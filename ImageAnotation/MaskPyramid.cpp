@@ -0,0 +1,134 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "MaskPyramid.h"
+
+#include <math.h>
+
+
+MaskPyramid::MaskPyramid()
+{
+    _valid = false;
+}
+
+void MaskPyramid::reset()
+{
+    // the levels are rebuilt the next time they are needed
+    _valid = false;
+    _dirty = QRect();
+}
+
+void MaskPyramid::release()
+{
+    // like reset .. but the memory of the levels is freed as well
+    reset();
+    _levels.clear();
+}
+
+qint64 MaskPyramid::byte_count() const
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < _levels.size(); ++i)
+        bytes += qint64(_levels[i].bytesPerLine()) * _levels[i].height();
+    return bytes;
+}
+
+void MaskPyramid::invalidate(const QRect &dirty)
+{
+    // only remember the region .. it is pooled again when a level is needed
+    if (_valid)
+        _dirty |= dirty;
+}
+
+int MaskPyramid::level_for_zoom(double zoom) const
+{
+    // the finest level that does not have to be scaled down, i.e., it is
+    // drawn with a scale factor within [1, 2) and no pixel gets dropped
+    if (zoom >= 1.0 || zoom <= 0.0)
+        return 0;
+    return int(ceil(log(1.0 / zoom) / log(2.0) - 1e-9));
+}
+
+const QImage &MaskPyramid::level(const QImage &mask, int level)
+{
+    if (level <= 0)
+        return mask;
+
+    if (!_valid || mask.size() != _mask_size) {
+        build_i(mask);
+    }
+    else if (!_dirty.isEmpty()) {
+        // pool the changed region through all levels
+        QRect rect = _dirty & mask.rect();
+        const QImage *src = &mask;
+        for (int i = 0; i < _levels.size() && !rect.isEmpty(); ++i) {
+            rect = QRect(QPoint(rect.left() / 2, rect.top() / 2), QPoint(rect.right() / 2, rect.bottom() / 2)) & _levels[i].rect();
+            pool_i(*src, _levels[i], rect);
+            src = &_levels[i];
+        }
+        _dirty = QRect();
+    }
+
+    if (_levels.isEmpty())
+        return mask;
+    return _levels[qMin(level, _levels.size()) - 1];
+}
+
+void MaskPyramid::build_i(const QImage &mask)
+{
+    _levels.clear();
+    _mask_size = mask.size();
+    _dirty = QRect();
+    _valid = true;
+
+    const QImage *src = &mask;
+    while (src->width() > MASK_PYRAMID_MIN_SIZE || src->height() > MASK_PYRAMID_MIN_SIZE) {
+        QImage dst((src->width() + 1) / 2, (src->height() + 1) / 2, QImage::Format_ARGB32_Premultiplied);
+        pool_i(*src, dst, dst.rect());
+        _levels << dst;
+        src = &_levels.last();
+    }
+}
+
+void MaskPyramid::pool_i(const QImage &src, QImage &dst, const QRect &dst_rect)
+{
+    // the drawing mask is ARGB32_Premultiplied with all background pixels
+    // set to zero
+    for (int y = dst_rect.top(); y <= dst_rect.bottom(); ++y) {
+        const QRgb *src_lines[2];
+        src_lines[0] = reinterpret_cast<const QRgb *>(src.constScanLine(2 * y));
+        src_lines[1] = 2 * y + 1 < src.height() ? reinterpret_cast<const QRgb *>(src.constScanLine(2 * y + 1)) : NULL;
+        QRgb *dst_line = reinterpret_cast<QRgb *>(dst.scanLine(y));
+        for (int x = dst_rect.left(); x <= dst_rect.right(); ++x) {
+            QRgb best = 0;
+            for (int dy = 0; dy < 2 && src_lines[dy]; ++dy) {
+                for (int dx = 0; dx < 2 && 2 * x + dx < src.width(); ++dx) {
+                    QRgb pixel = src_lines[dy][2 * x + dx];
+                    if (pixel == 0)
+                        continue;
+                    if (best == 0 || (qRed(pixel) > 0 && qRed(best) == 0))
+                        best = pixel;
+                }
+            }
+            dst_line[x] = best;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef MaskPyramid_H
+#define MaskPyramid_H
+
+#include <QVector>
+#include <QRect>
+#include <QSize>
+#include <QImage>
+
+// levels below this size are not built any more
+#define MASK_PYRAMID_MIN_SIZE 16
+
+
+// downscaled versions of the drawing mask for zoom factors below 1 .. each
+// level halves the previous one, a pixel is set as soon as any of its 2x2
+// source pixels is set (confident labels win), so that lesions of a few
+// pixels stay visible
+class MaskPyramid
+{
+public:
+    MaskPyramid();
+
+    void reset();
+    void release();
+    void invalidate(const QRect &dirty);
+    int level_for_zoom(double zoom) const;
+    const QImage &level(const QImage &mask, int level);
+    qint64 byte_count() const;
+
+private:
+    void build_i(const QImage &mask);
+    static void pool_i(const QImage &src, QImage &dst, const QRect &dst_rect);
+
+private:
+    // _levels[i] is level i+1, i.e., it is scaled by 1/2^(i+1)
+    QVector<QImage> _levels;
+    QSize _mask_size;
+    bool _valid;
+    QRect _dirty;
+};
+
+#endif
@@ -0,0 +1,277 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "MaskWorkingSet.h"
+
+#include <QTimer>
+#include <QRunnable>
+#include <QCoreApplication>
+#include <QEvent>
+
+
+// ========== MaskWriteTask ==========
+
+// writes one mask .. the result is sent back with a queued call
+class MaskWriteTask : public QRunnable
+{
+public:
+    MaskWriteTask(MaskWorkingSet *working_set, const QString &image, int class_id, int version, const QString &file, const QImage &mask)
+        : _working_set(working_set), _image(image), _class_id(class_id), _version(version), _file(file), _mask(mask) {}
+
+    void run()
+    {
+        bool ok = _mask.save(_file, "PNG");
+        QMetaObject::invokeMethod(_working_set, "slot_layer_written_i", Qt::QueuedConnection,
+            Q_ARG(QString, _image), Q_ARG(int, _class_id), Q_ARG(int, _version), Q_ARG(bool, ok));
+    }
+
+private:
+    MaskWorkingSet *_working_set;
+    QString _image;
+    int _class_id;
+    int _version;
+    QString _file;
+    // a shallow copy .. edits in the gui thread detach from it
+    QImage _mask;
+};
+
+
+// ========== MaskWorkingSet ==========
+
+MaskWorkingSet::MaskWorkingSet(MemoryBudget *budget, QObject *parent)
+    : QObject(parent)
+{
+    // one writer keeps the writes of a file in order
+    _pool.setMaxThreadCount(1);
+    _flush_timer = new QTimer(this);
+    _flush_timer->setSingleShot(true);
+    _flush_timer->setInterval(WORKING_SET_FLUSH_DELAY);
+    connect(_flush_timer, SIGNAL(timeout()), this, SLOT(slot_flush_i()));
+
+    _budget = budget;
+    _cache = _budget->add_cache("Working set", MemoryBudget::Normal, this);
+}
+
+MaskWorkingSet::~MaskWorkingSet()
+{
+    flush();
+    _budget->remove_cache(_cache);
+}
+
+bool MaskWorkingSet::mask(const QString &image, int class_id, QImage &mask)
+{
+    if (!_entries.contains(image) || !_entries[image].layers.contains(class_id))
+        return false;
+
+    touch_i(image);
+    mask = _entries[image].layers[class_id].mask;
+    return true;
+}
+
+void MaskWorkingSet::set_mask(const QString &image, int class_id, const QString &file, const QImage &mask, bool dirty)
+{
+    Layer &layer = entry_i(image).layers[class_id];
+    layer.mask = mask;
+    layer.file = file;
+    if (dirty)
+    {
+        // the write is delayed a bit .. quick successive strokes are
+        // written only once
+        layer.dirty = true;
+        layer.version++;
+        _flush_timer->start();
+    }
+    update_usage_i();
+}
+
+QImage MaskWorkingSet::picture(const QString &image)
+{
+    if (!_entries.contains(image))
+        return QImage();
+
+    touch_i(image);
+    return _entries[image].picture;
+}
+
+void MaskWorkingSet::set_picture(const QString &image, const QImage &picture)
+{
+    entry_i(image).picture = picture;
+    update_usage_i();
+}
+
+QImage MaskWorkingSet::view(const QString &image, int mode)
+{
+    if (!_entries.contains(image))
+        return QImage();
+
+    touch_i(image);
+    return _entries[image].views.value(mode);
+}
+
+void MaskWorkingSet::set_view(const QString &image, int mode, const QImage &view)
+{
+    entry_i(image).views.insert(mode, view);
+    update_usage_i();
+}
+
+void MaskWorkingSet::flush()
+{
+    _flush_timer->stop();
+    slot_flush_i();
+    _pool.waitForDone();
+
+    // deliver the results of the writes .. failed ones are dirty again and
+    // get a last try right here
+    QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+    QHash<QString, Entry>::iterator it;
+    for (it = _entries.begin(); it != _entries.end(); ++it)
+    {
+        QHash<int, Layer>::iterator layer;
+        for (layer = it.value().layers.begin(); layer != it.value().layers.end(); ++layer)
+        {
+            if (!layer.value().dirty)
+                continue;
+            if (layer.value().mask.save(layer.value().file, "PNG"))
+            {
+                layer.value().dirty = false;
+                emit layer_written(it.key(), layer.key());
+            }
+            else
+                emit flush_failed(layer.value().file);
+        }
+    }
+
+    update_usage_i();
+}
+
+qint64 MaskWorkingSet::evict(int, qint64 bytes)
+{
+    // the least recently used images first .. the current one and those
+    // with unwritten masks stay
+    qint64 freed = 0;
+    for (int i = _order.size() - 1; i > 0 && freed < bytes; --i)
+        freed += drop_i(_order[i]);
+
+    qint64 usage = 0;
+    QHash<QString, Entry>::const_iterator it;
+    for (it = _entries.constBegin(); it != _entries.constEnd(); ++it)
+        usage += entry_bytes_i(it.value());
+    return usage;
+}
+
+void MaskWorkingSet::slot_flush_i()
+{
+    QHash<QString, Entry>::iterator it;
+    for (it = _entries.begin(); it != _entries.end(); ++it)
+    {
+        QHash<int, Layer>::iterator layer;
+        for (layer = it.value().layers.begin(); layer != it.value().layers.end(); ++layer)
+        {
+            Layer &l = layer.value();
+            if (!l.dirty)
+                continue;
+            l.dirty = false;
+            l.writing++;
+            _pool.start(new MaskWriteTask(this, it.key(), layer.key(), l.version, l.file, l.mask));
+        }
+    }
+}
+
+void MaskWorkingSet::slot_layer_written_i(const QString &image, int class_id, int version, bool ok)
+{
+    if (!_entries.contains(image) || !_entries[image].layers.contains(class_id))
+        return;
+
+    Layer &layer = _entries[image].layers[class_id];
+    layer.writing--;
+    if (!ok)
+    {
+        // keep it dirty if no newer version is on its way
+        if (version == layer.version)
+            layer.dirty = true;
+        emit flush_failed(layer.file);
+    }
+    else if (version == layer.version)
+    {
+        emit layer_written(image, class_id);
+    }
+}
+
+MaskWorkingSet::Entry &MaskWorkingSet::entry_i(const QString &image)
+{
+    touch_i(image);
+
+    // forget the images that have not been used for the longest time
+    for (int i = _order.size() - 1; i >= WORKING_SET_SIZE; --i)
+        drop_i(_order[i]);
+
+    return _entries[image];
+}
+
+void MaskWorkingSet::touch_i(const QString &image)
+{
+    _order.removeOne(image);
+    _order.prepend(image);
+}
+
+bool MaskWorkingSet::is_busy_i(const Entry &entry) const
+{
+    QHash<int, Layer>::const_iterator layer;
+    for (layer = entry.layers.constBegin(); layer != entry.layers.constEnd(); ++layer)
+    {
+        if (layer.value().dirty || layer.value().writing > 0)
+            return true;
+    }
+    return false;
+}
+
+qint64 MaskWorkingSet::drop_i(const QString &image)
+{
+    // images with unwritten masks are dropped later
+    if (!_entries.contains(image) || is_busy_i(_entries[image]))
+        return 0;
+
+    qint64 bytes = entry_bytes_i(_entries[image]);
+    _entries.remove(image);
+    _order.removeOne(image);
+    return bytes;
+}
+
+qint64 MaskWorkingSet::entry_bytes_i(const Entry &entry) const
+{
+    qint64 bytes = MemoryBudget::image_bytes(entry.picture);
+    QHash<int, QImage>::const_iterator view;
+    for (view = entry.views.constBegin(); view != entry.views.constEnd(); ++view)
+        bytes += MemoryBudget::image_bytes(view.value());
+    QHash<int, Layer>::const_iterator layer;
+    for (layer = entry.layers.constBegin(); layer != entry.layers.constEnd(); ++layer)
+        bytes += MemoryBudget::image_bytes(layer.value().mask);
+    return bytes;
+}
+
+void MaskWorkingSet::update_usage_i()
+{
+    qint64 bytes = 0;
+    QHash<QString, Entry>::const_iterator it;
+    for (it = _entries.constBegin(); it != _entries.constEnd(); ++it)
+        bytes += entry_bytes_i(it.value());
+    _budget->set_usage(_cache, bytes);
+}
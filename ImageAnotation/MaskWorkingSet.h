@@ -0,0 +1,114 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef MaskWorkingSet_H
+#define MaskWorkingSet_H
+
+#include <QObject>
+#include <QString>
+#include <QImage>
+#include <QHash>
+#include <QList>
+#include <QThreadPool>
+#include "MemoryBudget.h"
+
+class QTimer;
+
+// number of images whose picture and masks stay in memory
+#define WORKING_SET_SIZE 4
+// edits are written to disk this long (ms) after the last change
+#define WORKING_SET_FLUSH_DELAY 500
+
+
+// the pictures (with their enhanced views) and class masks of the most
+// recently shown images .. edited masks are marked dirty and written on a
+// worker thread, going back to an image does not touch the disk at all
+class MaskWorkingSet : public QObject, public MemoryClient
+{
+    Q_OBJECT
+
+public:
+    MaskWorkingSet(MemoryBudget *budget, QObject *parent = 0);
+    virtual ~MaskWorkingSet();
+
+    bool mask(const QString &image, int class_id, QImage &mask);
+    void set_mask(const QString &image, int class_id, const QString &file, const QImage &mask, bool dirty);
+    QImage picture(const QString &image);
+    void set_picture(const QString &image, const QImage &picture);
+    // the enhanced views of the picture (see ImageEnhancer::Mode)
+    QImage view(const QString &image, int mode);
+    void set_view(const QString &image, int mode, const QImage &view);
+
+    // writes all dirty masks and waits until they are on disk
+    void flush();
+
+    virtual qint64 evict(int cache, qint64 bytes);
+
+signals:
+    void flush_failed(const QString &file);
+    // the newest version of a mask is on disk
+    void layer_written(const QString &image, int class_id);
+
+private slots:
+    void slot_flush_i();
+    void slot_layer_written_i(const QString &image, int class_id, int version, bool ok);
+
+private:
+    class Layer
+    {
+    public:
+        Layer() : dirty(false), version(0), writing(0) {}
+
+        QImage mask;
+        QString file;
+        bool dirty;
+        int version;
+        int writing;
+    };
+
+    class Entry
+    {
+    public:
+        QImage picture;
+        QHash<int, QImage> views;
+        QHash<int, Layer> layers;
+    };
+
+    Entry &entry_i(const QString &image);
+    void touch_i(const QString &image);
+    bool is_busy_i(const Entry &entry) const;
+    qint64 drop_i(const QString &image);
+    qint64 entry_bytes_i(const Entry &entry) const;
+    void update_usage_i();
+
+private:
+    friend class MaskWriteTask;
+
+    MemoryBudget *_budget;
+    int _cache;
+    QHash<QString, Entry> _entries;
+    // most recently used first
+    QList<QString> _order;
+    QThreadPool _pool;
+    QTimer *_flush_timer;
+};
+
+#endif
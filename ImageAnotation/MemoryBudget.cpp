@@ -0,0 +1,160 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "MemoryBudget.h"
+
+
+MemoryBudget::MemoryBudget(qint64 limit, QObject *parent)
+    : QObject(parent)
+{
+    _limit = limit;
+    _usage = 0;
+    _clock = 0;
+    _enforcing = false;
+}
+
+int MemoryBudget::add_cache(const QString &name, Priority priority, MemoryClient *client)
+{
+    Cache cache;
+    cache.name = name;
+    cache.priority = priority;
+    cache.client = client;
+    cache.last_use = ++_clock;
+    cache.active = true;
+    _caches.append(cache);
+    return _caches.size() - 1;
+}
+
+void MemoryBudget::remove_cache(int cache)
+{
+    // ids are never reused
+    if (cache < 0 || cache >= _caches.size() || !_caches[cache].active)
+        return;
+    _usage -= _caches[cache].bytes;
+    _caches[cache] = Cache();
+    emit usage_changed(_usage, _limit);
+}
+
+void MemoryBudget::set_usage(int cache, qint64 bytes)
+{
+    if (cache < 0 || cache >= _caches.size() || !_caches[cache].active)
+        return;
+
+    Cache &c = _caches[cache];
+    c.last_use = ++_clock;
+    if (c.bytes == bytes)
+        return;
+    _usage += bytes - c.bytes;
+    c.bytes = bytes;
+
+    // the cache that just grew is in use .. make room elsewhere
+    if (_usage > _limit)
+        enforce_i(cache);
+    emit usage_changed(_usage, _limit);
+}
+
+void MemoryBudget::touch(int cache)
+{
+    if (cache >= 0 && cache < _caches.size())
+        _caches[cache].last_use = ++_clock;
+}
+
+void MemoryBudget::set_limit(qint64 limit)
+{
+    _limit = limit;
+    if (_usage > _limit)
+        enforce_i(-1);
+    emit usage_changed(_usage, _limit);
+}
+
+qint64 MemoryBudget::limit() const
+{
+    return _limit;
+}
+
+qint64 MemoryBudget::usage() const
+{
+    return _usage;
+}
+
+qint64 MemoryBudget::usage(int cache) const
+{
+    if (cache < 0 || cache >= _caches.size())
+        return 0;
+    return _caches[cache].bytes;
+}
+
+QString MemoryBudget::report() const
+{
+    // one line per cache .. used for the tool tip in the status bar
+    QString text = QString("%1 / %2 MB").arg(_usage >> 20).arg(_limit >> 20);
+    for (int i = 0; i < _caches.size(); ++i) {
+        if (!_caches[i].active)
+            continue;
+        text += QString("\n%1: %2 MB").arg(_caches[i].name).arg(double(_caches[i].bytes) / (1 << 20), 0, 'f', 1);
+    }
+    return text;
+}
+
+qint64 MemoryBudget::image_bytes(const QImage &image)
+{
+    return qint64(image.bytesPerLine()) * image.height();
+}
+
+qint64 MemoryBudget::image_bytes(const QPixmap &pixmap)
+{
+    return qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+}
+
+void MemoryBudget::enforce_i(int keep)
+{
+    // an eviction must not trigger another one
+    if (_enforcing)
+        return;
+    _enforcing = true;
+
+    // every cache is asked at most once per round
+    QVector<bool> asked(_caches.size(), false);
+    while (_usage > _limit) {
+        // lowest priority first, then least recently used
+        int victim = -1;
+        for (int i = 0; i < _caches.size(); ++i) {
+            const Cache &c = _caches[i];
+            if (!c.active || c.priority == Pinned || c.bytes == 0 || i == keep || asked[i])
+                continue;
+            if (victim < 0 || c.priority > _caches[victim].priority
+                || (c.priority == _caches[victim].priority && c.last_use < _caches[victim].last_use))
+                victim = i;
+        }
+        if (victim < 0)
+            break;
+
+        asked[victim] = true;
+        Cache &c = _caches[victim];
+        qint64 bytes = c.client->evict(victim, _usage - _limit);
+        if (bytes >= c.bytes)
+            continue;
+        _usage -= c.bytes - bytes;
+        c.bytes = bytes;
+    }
+
+    _enforcing = false;
+}
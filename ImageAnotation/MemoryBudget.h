@@ -0,0 +1,103 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef MemoryBudget_H
+#define MemoryBudget_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QImage>
+#include <QPixmap>
+
+// memory ceiling (in MB) if none has been configured
+#define MEMORY_BUDGET_DEFAULT_MB 2048
+
+
+// something that holds one or more caches registered at a MemoryBudget
+class MemoryClient
+{
+public:
+    virtual ~MemoryClient() {}
+
+    // free (at least) bytes of the given cache if possible and return its
+    // new usage .. must not call back into the budget
+    virtual qint64 evict(int cache, qint64 bytes) = 0;
+};
+
+
+// accounts the memory of all large buffers of the application .. if the
+// ceiling is exceeded, caches are evicted by priority (low first) and
+// within a priority the least recently used first. only used from the
+// gui thread
+class MemoryBudget : public QObject
+{
+    Q_OBJECT
+
+public:
+    // pinned caches are accounted but never evicted
+    enum Priority { Pinned, High, Normal, Low };
+
+public:
+    MemoryBudget(qint64 limit, QObject *parent = 0);
+
+    int add_cache(const QString &name, Priority priority, MemoryClient *client);
+    void remove_cache(int cache);
+    void set_usage(int cache, qint64 bytes);
+    void touch(int cache);
+
+    void set_limit(qint64 limit);
+    qint64 limit() const;
+    qint64 usage() const;
+    qint64 usage(int cache) const;
+    QString report() const;
+
+    static qint64 image_bytes(const QImage &image);
+    static qint64 image_bytes(const QPixmap &pixmap);
+
+signals:
+    void usage_changed(qint64 usage, qint64 limit);
+
+private:
+    void enforce_i(int keep);
+
+private:
+    class Cache
+    {
+    public:
+        Cache() : priority(Pinned), client(NULL), bytes(0), last_use(0), active(false) {}
+
+        QString name;
+        Priority priority;
+        MemoryClient *client;
+        qint64 bytes;
+        quint64 last_use;
+        bool active;
+    };
+
+    QVector<Cache> _caches;
+    qint64 _limit;
+    qint64 _usage;
+    quint64 _clock;
+    bool _enforcing;
+};
+
+#endif
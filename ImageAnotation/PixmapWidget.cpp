@@ -24,6 +24,7 @@
 #include <iostream>
 #include <math.h>
 #include <time.h>
+#include <string.h>
 
 #include "defines.h"
 #include <QPixmap>
@@ -37,6 +38,12 @@
 #include <QtDebug>
 #include <QMainWindow>
 #include <QStatusBar>
+#include <QHash>
+#include <QtAlgorithms>
+#include <limits.h>
+
+// changes of more overlay objects repaint the whole view
+#define OVERLAY_MAX_DIRTY_ITEMS 64
 
 namespace
 {
@@ -44,6 +51,58 @@ namespace
     {
         return (number > 0.0) ? floor(number + 0.5) : ceil(number - 0.5);
     }
+
+    // moves the content of an image by (dx, dy) pixels in place .. what is
+    // moved in from outside is left as it is and has to be redrawn
+    void scroll_image(QImage &image, int dx, int dy)
+    {
+        int w = image.width(), h = image.height();
+        if (qAbs(dx) >= w || qAbs(dy) >= h)
+            return;
+
+        int bpp = image.depth() / 8;
+        int rowBytes = (w - qAbs(dx)) * bpp;
+        int srcX = dx < 0 ? -dx : 0;
+        int dstX = dx > 0 ? dx : 0;
+        if (dy > 0)
+        {
+            for (int y = h - 1; y >= dy; --y)
+                memmove(image.scanLine(y) + dstX * bpp, image.scanLine(y - dy) + srcX * bpp, rowBytes);
+        }
+        else
+        {
+            for (int y = 0; y < h + dy; ++y)
+                memmove(image.scanLine(y) + dstX * bpp, image.scanLine(y - dy) + srcX * bpp, rowBytes);
+        }
+    }
+
+    // the overlay primitives of one object type .. they are drawn with a
+    // single call each
+    class OverlayBatch
+    {
+    public:
+        int type_id;
+        QVector<QRectF> rects;
+        QVector<QPointF> points;
+    };
+}
+
+
+bool OverlayItem::operator<(const OverlayItem &other) const
+{
+    // any strict order will do, it only has to put equal items next to
+    // each other
+    if (type_id != other.type_id)
+        return type_id < other.type_id;
+    if (score != other.score)
+        return score < other.score;
+    if (bounds.x() != other.bounds.x())
+        return bounds.x() < other.bounds.x();
+    if (bounds.y() != other.bounds.y())
+        return bounds.y() < other.bounds.y();
+    if (bounds.width() != other.bounds.width())
+        return bounds.width() < other.bounds.width();
+    return bounds.height() < other.bounds.height();
 }
 
 
@@ -53,19 +112,41 @@ PixmapWidget::PixmapWidget( QAbstractScrollArea *parentScrollArea, QWidget *pare
     _scroll_area = parentScrollArea;
     _parent_window = qobject_cast<QMainWindow*>(parent);
     _pixmap = new QPixmap();
+    _image_size = _pixmap->size();
     _zoom_factor = 1.0;
     _pen_width = 5;
+    _tool = ToolBrush;
+    _wand_tolerance = MAGIC_WAND_DEFAULT_TOLERANCE;
+    _wand_press_tolerance = _wand_tolerance;
     _mask_transparency = 1.0;
+    _mask_display_mode = MaskFilled;
     _is_drawing = false;
     _enable_painting = false;
     _is_confident = true;
     _is_erasing = false;
+    _overlay_annotation = NULL;
+    _overlay_handle = IA_INVALID_HANDLE;
+    _lesion_annotation = NULL;
+    _lesion_handle = IA_INVALID_HANDLE;
+    _overlay_visible = true;
+    _overlay_score_threshold = -1e300;
+    _backbuffer_valid = false;
+    _memory_budget = NULL;
+    _image_cache = _mask_cache = _backbuffer_cache = _pyramid_cache = _contours_cache = _superpixel_cache = -1;
+    _superpixel_overlay_level = -1;
 
     setAttribute(Qt::WA_OpaquePaintEvent);
     setFocusPolicy(Qt::NoFocus);
-    setMinimumSize( _pixmap->width()*_zoom_factor, _pixmap->height()*_zoom_factor );
     setMouseTracking(true);
 
+    // we are a fixed size viewport .. the scroll bars only tell us the pan
+    if (_scroll_area)
+    {
+        connect(_scroll_area->horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(slot_scrolled_i()));
+        connect(_scroll_area->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(slot_scrolled_i()));
+    }
+    update_view_matrix_i();
+
 
     makeCurrent();
 
@@ -80,34 +161,90 @@ PixmapWidget::~PixmapWidget()
 
 void PixmapWidget::slot_zoom_factor_changed( double f )
 {
-    int w, h;
+    // zooms from the spin box keep the center of the view in place
+    zoom_at(f, rect().center());
+}
 
+void PixmapWidget::zoom_at( double f, const QPoint &anchor )
+{
     if( fabs(f - _zoom_factor) <= 0.001 )
         return;
 
+    // the image point below the anchor before zooming
+    QPointF xyImage = _current_matrix_inv.map(QPointF(anchor));
+
     _zoom_factor = f;
     emit( zoomFactorChanged( _zoom_factor ) );
 
-    w = _pixmap->width()*_zoom_factor;
-    h = _pixmap->height()*_zoom_factor;
-    setMinimumSize( w, h );
-    //std::cout << w << " , " << h << std::endl;
-
-    QWidget *p = dynamic_cast<QWidget*>( parent() );
-    if( p )
+    // new scroll ranges first .. then pan such that the image point is
+    // below the anchor again (the scroll bars clamp at the borders)
+    update_scroll_bars_i();
+    if (_scroll_area)
     {
-        //std::cout << p->width()<< " " << p->height() << std::endl;
-        resize( p->width(), p->height() );
+        _scroll_area->horizontalScrollBar()->setValue(round(xyImage.x() * _zoom_factor - anchor.x()));
+        _scroll_area->verticalScrollBar()->setValue(round(xyImage.y() * _zoom_factor - anchor.y()));
     }
+    update_view_matrix_i();
+
+    invalidate_backbuffer_i();
+    update();
+}
 
+void PixmapWidget::slot_scrolled_i()
+{
+    update_view_matrix_i();
     update();
 }
 
+void PixmapWidget::update_scroll_bars_i()
+{
+    if (!_scroll_area)
+        return;
+
+    // the scroll bars span the zoomed image .. one page is our own size
+    int w = round(_image_size.width() * _zoom_factor);
+    int h = round(_image_size.height() * _zoom_factor);
+    QScrollBar *scrollBar = _scroll_area->horizontalScrollBar();
+    scrollBar->setRange(0, MAX(0, w - width()));
+    scrollBar->setPageStep(width());
+    scrollBar->setSingleStep(20);
+    scrollBar = _scroll_area->verticalScrollBar();
+    scrollBar->setRange(0, MAX(0, h - height()));
+    scrollBar->setPageStep(height());
+    scrollBar->setSingleStep(20);
+}
+
+void PixmapWidget::update_view_matrix_i()
+{
+    // widget coordinates = zoom * image coordinates - pan .. an image smaller
+    // than the view is centered instead
+    double w = _image_size.width() * _zoom_factor;
+    double h = _image_size.height() * _zoom_factor;
+    double dx = 0, dy = 0;
+    if (w < width())
+        dx = int((width() - w) / 2);
+    else if (_scroll_area)
+        dx = -_scroll_area->horizontalScrollBar()->value();
+    if (h < height())
+        dy = int((height() - h) / 2);
+    else if (_scroll_area)
+        dy = -_scroll_area->verticalScrollBar()->value();
+
+    _current_matrix = QMatrix(_zoom_factor, 0, 0, _zoom_factor, dx, dy);
+    _current_matrix_inv = _current_matrix.inverted();
+}
+
 const QImage& PixmapWidget::get_draw_mask() const
 {
     return _drawMask;
 }
 
+QRect PixmapWidget::get_stroke_rect() const
+{
+    // the part of the mask (in image coordinates) changed by the last stroke
+    return _stroke_rect;
+}
+
 void PixmapWidget::set_pen_width(int width)
 {
     _pen_width = width;
@@ -133,11 +270,70 @@ void PixmapWidget::set_mask(QImage& input_mask)
             }
         }
     }
+    _mask_contours.reset(_drawMask.size());
+    _mask_pyramid.reset();
+    _magic_wand.clear();
+    update_wand_preview_i();
+    clear_live_wire_i();
+    update_memory_usage_i();
     // we have to repaint
+    invalidate_backbuffer_i();
     repaint();
 }
 
 
+void PixmapWidget::set_view(const QImage &view)
+{
+    _view = view;
+    _view_ready = view.isNull() ? QRegion() : QRegion(view.rect());
+    update_memory_usage_i();
+    invalidate_backbuffer_i();
+    update();
+}
+
+void PixmapWidget::set_view_tile(const QRect &rect, const QImage &tile)
+{
+    if (_view.size() != _image_size || _view.format() != tile.format())
+    {
+        _view = QImage(_image_size, tile.format());
+        _view.setColorTable(tile.colorTable());
+        _view_ready = QRegion();
+        update_memory_usage_i();
+    }
+
+    QRect target = rect & _view.rect();
+    const int bpl = target.width() * _view.depth() / 8;
+    for (int y = 0; y < target.height(); ++y)
+        memcpy(_view.scanLine(target.y() + y) + target.x() * _view.depth() / 8, tile.constScanLine(y), bpl);
+    _view_ready += target;
+
+    QRect targetOrg = _current_matrix.mapRect(QRectF(target)).toAlignedRect().adjusted(-1, -1, 1, 1);
+    invalidate_backbuffer_i(targetOrg);
+    update(targetOrg);
+}
+
+const QImage& PixmapWidget::get_view() const
+{
+    return _view;
+}
+
+const QSize &PixmapWidget::get_image_size() const
+{
+    return _image_size;
+}
+
+void PixmapWidget::set_superpixels(const Superpixels &superpixels)
+{
+    _superpixels = superpixels;
+    _superpixel_overlay = QImage();
+    update_memory_usage_i();
+    if (_tool == ToolSuperpixels)
+    {
+        invalidate_backbuffer_i();
+        update();
+    }
+}
+
 void PixmapWidget::set_mask_transparency(double transparency)
 {
     if (abs(transparency - _mask_transparency) < 1e-6)
@@ -176,20 +372,42 @@ void PixmapWidget::set_mask_transparency(double transparency)
             }
         }
     }
+    _mask_pyramid.reset();
 
     
 
+    invalidate_backbuffer_i();
     update();
 }
 
-void PixmapWidget::set_pixmap( const QPixmap& pixmap)
+void PixmapWidget::set_pixmap( const QPixmap& pixmap, const QSize &image_size )
 {
     delete _pixmap;
     _pixmap = new QPixmap(pixmap);
 
+    // a preview is stretched over the size of the full image .. so the view
+    // and all coordinates stay the same when the full image replaces it
+    _image_size = image_size.isValid() ? image_size : _pixmap->size();
+    if (_view.size() != _image_size)
+    {
+        _view = QImage();
+        _view_ready = QRegion();
+    }
+    if (_superpixels.size() != _image_size)
+    {
+        _superpixels = Superpixels();
+        _superpixel_overlay = QImage();
+    }
+    _magic_wand.clear();
+    update_wand_preview_i();
+    clear_live_wire_i();
+
     emit( pixmapChanged( _pixmap ) );
+    update_memory_usage_i();
 
-    setMinimumSize( _pixmap->width()*_zoom_factor, _pixmap->height()*_zoom_factor );
+    update_scroll_bars_i();
+    update_view_matrix_i();
+    invalidate_backbuffer_i();
     repaint();
 }
 
@@ -205,116 +423,60 @@ void PixmapWidget::paintEvent( QPaintEvent *event )
     //swapBuffers();
     //return;
 
-    bool drawBorder = false;
-    int xOffset = 0, yOffset = 0;
+    //
+    // bring the backbuffer (image, mask and boxes) up to date
+    //
 
-    if( width() > _pixmap->width()*_zoom_factor ) {
-        xOffset = (width()-_pixmap->width()*_zoom_factor)/2;
-        drawBorder = true;
+    if (_backbuffer.size() != size())
+    {
+        _backbuffer = QImage(size(), QImage::Format_ARGB32_Premultiplied);
+        _backbuffer_valid = false;
+        if (_memory_budget)
+            _memory_budget->set_usage(_backbuffer_cache, MemoryBudget::image_bytes(_backbuffer));
     }
 
-    if( height() > _pixmap->height()*_zoom_factor ) {
-        yOffset = (height()-_pixmap->height()*_zoom_factor)/2;
-        drawBorder = true;
+    QPoint origin(round(_current_matrix.dx()), round(_current_matrix.dy()));
+    if (!_backbuffer_valid)
+    {
+        render_backbuffer_i(rect());
+        _backbuffer_valid = true;
     }
-
-    // get the current value of the parent scroll area .. to optimize the painting
-    double hValue = 0, hMin = 0, hMax = 0, hPageStep = 0, hLength = 0;
-    double vValue = 0, vMin = 0, vMax = 0, vPageStep = 0, vLength = 0;
-    if (_scroll_area) 
+    else
     {
-        QScrollBar *scrollBar;
-        scrollBar = _scroll_area->horizontalScrollBar();
-        if (scrollBar) 
-        {
-            hValue = scrollBar->value();
-            hMin = scrollBar->minimum();
-            hMax = scrollBar->maximum();
-            hPageStep = scrollBar->pageStep();
-            hLength = hMax - hMin + hPageStep;
-        }
-        scrollBar = _scroll_area->verticalScrollBar();
-        if (scrollBar) 
+        // we have been panned .. move what we have and render only the
+        // strips which became visible
+        if (origin != _backbuffer_origin)
         {
-            vValue = scrollBar->value();
-            vMin = scrollBar->minimum();
-            vMax = scrollBar->maximum();
-            vPageStep = scrollBar->pageStep();
-            vLength = vMax - vMin + vPageStep;
+            QPoint delta = origin - _backbuffer_origin;
+            scroll_image(_backbuffer, delta.x(), delta.y());
+            // what was pending moved along with the content
+            _backbuffer_dirty.translate(delta);
+            _backbuffer_dirty += QRegion(rect()).subtracted(QRegion(rect().translated(delta)));
         }
+        QVector<QRect> dirtyRects = _backbuffer_dirty.rects();
+        for (int i = 0; i < dirtyRects.size(); ++i)
+            render_backbuffer_i(dirtyRects[i] & rect());
     }
+    _backbuffer_origin = origin;
+    _backbuffer_dirty = QRegion();
 
     //
-    // draw image and the transparent image mask
+    // copy to the screen and draw brush and border on top
     //
 
     QPainter p(this);
     p.setRenderHint(QPainter::SmoothPixmapTransform, false);
     p.setRenderHint(QPainter::Antialiasing, false);
     p.setCompositionMode(QPainter::CompositionMode_Source);
+    p.drawImage(event->rect().topLeft(), _backbuffer, event->rect());
+    p.setCompositionMode(QPainter::CompositionMode_SourceOver);
 
     // adjust the coordinate system
     p.save();
-    p.translate(xOffset, yOffset);
-    p.scale(_zoom_factor, _zoom_factor);
-    _current_matrix_inv = p.matrix().inverted();
-    _current_matrix = p.matrix();
-
-    // find out which part of the image we have to draw
-    // since we are embedded into a QScrollArea and not all is visible
-    QRectF updateRectF = _current_matrix_inv.mapRect(event->rect());
-    if (_last_v_scroll_value != vValue || _last_h_scroll_value != hValue || updateRectF.isEmpty()) {
-        updateRectF.setLeft((hValue / hLength) * _pixmap->width());
-        updateRectF.setWidth((hPageStep / hLength) * _pixmap->width());
-        updateRectF.setTop((vValue / vLength) * _pixmap->height());
-        updateRectF.setHeight((vPageStep / vLength) * _pixmap->height());
-    }
-    QRect updateRect;
-    updateRect.setLeft(round(updateRectF.left()) - 1);
-    updateRect.setRight(round(updateRectF.right()) + 1);
-    updateRect.setTop(round(updateRectF.top()) - 1);
-    updateRect.setBottom(round(updateRectF.bottom()) + 1);
+    p.setMatrix(_current_matrix);
 
-    // save the scroll bar values
-    _last_v_scroll_value = vValue;
-    _last_h_scroll_value = hValue;
-
-    // find out what needs to be cleared on the canvas outside the image
-    QRectF eraseTop(updateRect.left(), updateRect.top(), updateRect.width(), -updateRect.top());
-    QRectF eraseBottom(updateRect.left(), _pixmap->height(), updateRect.width(), updateRect.height() - (-updateRect.top() + _pixmap->height()));
-    QRectF eraseLeft(updateRect.left(), 0, -updateRect.left(), _pixmap->height());
-    QRectF eraseRight(_pixmap->width(), 0, updateRect.height() - (-updateRect.left() + _pixmap->width()), _pixmap->height());
-    if (eraseTop.isValid())
-        p.eraseRect(eraseTop);
-    if (eraseBottom.isValid())
-        p.eraseRect(eraseBottom);
-    if (eraseLeft.isValid())
-        p.eraseRect(eraseLeft);
-    if (eraseRight.isValid())
-        p.eraseRect(eraseRight);
-
-    //std::cout<< "( "<<updateRect.left() << " , " << updateRect.right() << " ) " << " , ( "<<updateRect.bottom() << " , " << updateRect.top()<< " ) \n" ;
-
-    // draw the image
-    QRectF rect_whole;
-    rect_whole.setLeft(0);
-    rect_whole.setWidth(_pixmap->width());
-    rect_whole.setTop(0);
-    rect_whole.setHeight(_pixmap->height());
-
-    p.drawPixmap(rect_whole.topLeft(), *_pixmap, rect_whole);
-    //p.drawPixmap(updateRect.topLeft(), *_pixmap, updateRect);
-
-    if (_enable_painting)
+    if (_enable_painting && _tool == ToolBrush)
     {
-        // draw the mask
-        //p.drawImage(updateRect.topLeft(), _drawMask, updateRect);
-        if (_mask_transparency > 0.01)
-        {
-            p.setCompositionMode(QPainter::CompositionMode_SourceOver);
-            p.drawImage(rect_whole.topLeft(), _drawMask, rect_whole);
-        }
-
         //TODO using cursor to replace brush itself
         // draw the brush
         QPen penWhite(Qt::lightGray);
@@ -334,17 +496,212 @@ void PixmapWidget::paintEvent( QPaintEvent *event )
             _pen_width - 1 / _zoom_factor, _pen_width - 1 / _zoom_factor));
     }
 
+    if (_enable_painting && !_wire_path.isEmpty())
+    {
+        // the live wire .. the anchored part and the part following the cursor
+        p.setRenderHint(QPainter::Antialiasing, false);
+        p.translate(0.5, 0.5);
+        p.setPen(QPen(Qt::yellow, 0));
+        p.drawPolyline(_wire_path);
+        p.setPen(QPen(Qt::cyan, 0));
+        p.drawPolyline(_wire_preview);
+    }
+
     // draw a border around the image
     p.restore();
-    if (drawBorder) 
+    QRect imageRectOrg = _current_matrix.mapRect(QRectF(QPointF(0, 0), QSizeF(_image_size))).toAlignedRect();
+    if (imageRectOrg.width() < width() || imageRectOrg.height() < height()) 
     {
+        p.setRenderHint(QPainter::Antialiasing, false);
         p.setPen( Qt::black );
-        p.drawRect( xOffset-1, yOffset-1, _pixmap->width()*_zoom_factor+1, _pixmap->height()*_zoom_factor+1 );
+        p.drawRect( imageRectOrg.adjusted(-1, -1, 0, 0) );
     }
 
     swapBuffers();
 }
 
+void PixmapWidget::render_backbuffer_i(const QRect &rectOrg)
+{
+    if (rectOrg.isEmpty())
+        return;
+
+    //
+    // draw image and the transparent image mask
+    //
+
+    QPainter p(&_backbuffer);
+    p.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    p.setRenderHint(QPainter::Antialiasing, false);
+    p.setCompositionMode(QPainter::CompositionMode_Source);
+    p.setBackground(palette().window());
+    p.setClipRect(rectOrg);
+
+    // the image on the screen .. clear the canvas around it if needed
+    QRectF rect_whole(0, 0, _image_size.width(), _image_size.height());
+    QRect imageRectOrg = _current_matrix.mapRect(rect_whole).toAlignedRect();
+    if (!imageRectOrg.contains(rectOrg))
+        p.eraseRect(rectOrg);
+
+    // adjust the coordinate system
+    p.setMatrix(_current_matrix);
+
+    // find out which part of the image we have to draw .. only the part
+    // visible in our (fixed size) view, no matter how large the zoomed image is
+    QRectF updateRectF = _current_matrix_inv.mapRect(QRectF(rectOrg)) & rect_whole;
+    QRect updateRect;
+    updateRect.setLeft(round(updateRectF.left()) - 1);
+    updateRect.setRight(round(updateRectF.right()) + 1);
+    updateRect.setTop(round(updateRectF.top()) - 1);
+    updateRect.setBottom(round(updateRectF.bottom()) + 1);
+    updateRect &= QRect(QPoint(0, 0), _image_size);
+
+    // draw the image (an empty source rect would mean the whole pixmap)
+    if (!updateRect.isEmpty() && !_pixmap->isNull())
+    {
+        if (_pixmap->size() == _image_size)
+        {
+            p.drawPixmap(updateRect.topLeft(), *_pixmap, updateRect);
+        }
+        else
+        {
+            // only a preview so far .. take the matching part of it
+            double sx = double(_pixmap->width()) / _image_size.width();
+            double sy = double(_pixmap->height()) / _image_size.height();
+            QRectF previewRect(updateRect.x() * sx, updateRect.y() * sy, updateRect.width() * sx, updateRect.height() * sy);
+            p.setRenderHint(QPainter::SmoothPixmapTransform, true);
+            p.drawPixmap(QRectF(updateRect), *_pixmap, previewRect);
+            p.setRenderHint(QPainter::SmoothPixmapTransform, false);
+        }
+    }
+
+    // the enhanced view on top, where it is ready .. converted part by part,
+    // it is kept as gray values
+    if (!updateRect.isEmpty() && !_view.isNull())
+    {
+        QVector<QRect> viewRects = (_view_ready & updateRect).rects();
+        for (int i = 0; i < viewRects.size(); ++i)
+            p.drawImage(viewRects[i].topLeft(), _view.copy(viewRects[i]).convertToFormat(QImage::Format_RGB32));
+    }
+
+    if (_enable_painting && !updateRect.isEmpty())
+    {
+        // draw the mask
+        if (_mask_transparency > 0.01)
+        {
+            p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            if (_mask_display_mode == MaskOutline)
+            {
+                draw_mask_outline_i(p, updateRectF);
+            }
+            else if (_zoom_factor < 1.0)
+            {
+                // zoomed out .. draw a pooled level of the mask, which keeps
+                // small lesions visible and is cheaper to scale
+                int level = _mask_pyramid.level_for_zoom(_zoom_factor);
+                const QImage &level_mask = _mask_pyramid.level(_drawMask, level);
+                double level_scale = double(_drawMask.width()) / level_mask.width();
+                QRectF levelRect(updateRect.x() / level_scale, updateRect.y() / level_scale,
+                    updateRect.width() / level_scale, updateRect.height() / level_scale);
+                p.drawImage(QRectF(updateRect), level_mask, levelRect);
+                // the levels are built lazily .. report them once drawn
+                if (_memory_budget)
+                    _memory_budget->set_usage(_pyramid_cache, _mask_pyramid.byte_count());
+            }
+            else
+            {
+                p.drawImage(updateRect.topLeft(), _drawMask, updateRect);
+            }
+        }
+
+        // the region of the magic wand that has not been written yet
+        QRect previewRect = updateRect & _wand_preview_rect;
+        if (!_wand_preview.isNull() && !previewRect.isEmpty())
+        {
+            p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            p.drawImage(previewRect.topLeft(), _wand_preview, previewRect.translated(-_wand_preview_rect.topLeft()));
+        }
+
+        // the superpixel boundaries .. expanded once per zoom level, like
+        // the mask only the redrawn part is copied
+        if (_tool == ToolSuperpixels && _superpixels.size() == _image_size)
+        {
+            int level = _mask_pyramid.level_for_zoom(_zoom_factor);
+            const QImage &overlay = get_superpixel_overlay_i(level);
+            double level_scale = double(_image_size.width()) / overlay.width();
+            QRectF levelRect(updateRect.x() / level_scale, updateRect.y() / level_scale,
+                updateRect.width() / level_scale, updateRect.height() / level_scale);
+            p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            p.drawImage(QRectF(updateRect), overlay, levelRect);
+        }
+    }
+
+    // draw the boxes on top of the mask
+    p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    draw_overlay_i(p, get_overlay_file_i(), updateRectF, _overlay_score_threshold);
+    draw_overlay_i(p, get_lesion_file_i(), updateRectF, -1e300);
+}
+
+void PixmapWidget::set_memory_budget(MemoryBudget *budget)
+{
+    // the image and what is needed for every paint can not be evicted ..
+    // the mask caches are rebuilt on demand
+    _memory_budget = budget;
+    _image_cache = budget->add_cache("Image", MemoryBudget::Pinned, this);
+    _mask_cache = budget->add_cache("Mask", MemoryBudget::Pinned, this);
+    _backbuffer_cache = budget->add_cache("View buffer", MemoryBudget::Pinned, this);
+    _pyramid_cache = budget->add_cache("Mask pyramid", MemoryBudget::Low, this);
+    _contours_cache = budget->add_cache("Mask outlines", MemoryBudget::Low, this);
+    _superpixel_cache = budget->add_cache("Superpixel outlines", MemoryBudget::Low, this);
+    update_memory_usage_i();
+}
+
+qint64 PixmapWidget::evict(int cache, qint64)
+{
+    if (cache == _pyramid_cache)
+    {
+        _mask_pyramid.release();
+        return _mask_pyramid.byte_count();
+    }
+    if (cache == _contours_cache)
+    {
+        _mask_contours.reset(_drawMask.size());
+        return _mask_contours.byte_count();
+    }
+    if (cache == _superpixel_cache)
+    {
+        _superpixel_overlay = QImage();
+        return 0;
+    }
+    return _memory_budget->usage(cache);
+}
+
+void PixmapWidget::update_memory_usage_i()
+{
+    if (!_memory_budget)
+        return;
+
+    _memory_budget->set_usage(_image_cache, MemoryBudget::image_bytes(*_pixmap) + MemoryBudget::image_bytes(_view) + _superpixels.byte_count());
+    _memory_budget->set_usage(_mask_cache, MemoryBudget::image_bytes(_drawMask));
+    _memory_budget->set_usage(_backbuffer_cache, MemoryBudget::image_bytes(_backbuffer));
+    _memory_budget->set_usage(_pyramid_cache, _mask_pyramid.byte_count());
+    _memory_budget->set_usage(_contours_cache, _mask_contours.byte_count());
+    _memory_budget->set_usage(_superpixel_cache, MemoryBudget::image_bytes(_superpixel_overlay));
+}
+
+void PixmapWidget::invalidate_backbuffer_i()
+{
+    _backbuffer_valid = false;
+}
+
+void PixmapWidget::invalidate_backbuffer_i(const QRect &rectOrg)
+{
+    // rectOrg is in widget coordinates of the current view .. the dirty
+    // region is kept relative to what the backbuffer holds, which lags
+    // behind until the next paint when we have been panned meanwhile
+    QPoint origin(round(_current_matrix.dx()), round(_current_matrix.dy()));
+    _backbuffer_dirty += rectOrg.translated(_backbuffer_origin - origin);
+}
+
 void PixmapWidget::mousePressEvent(QMouseEvent * event)
 {
     if (!_enable_painting)
@@ -356,6 +713,76 @@ void PixmapWidget::mousePressEvent(QMouseEvent * event)
     QPoint xyMouseOrg(event->x(), event->y());
     QPoint xyMouse = _current_matrix_inv.map(xyMouseOrg);
 
+    if (_tool == ToolMagicWand)
+    {
+        // grow from the clicked pixel .. only in the full image, a preview
+        // does not have the details
+        bool onImage = QRect(QPoint(0, 0), _image_size).contains(xyMouse);
+        if ((event->button() == Qt::LeftButton || event->button() == Qt::RightButton)
+            && onImage && _pixmap->size() == _image_size && _mask_transparency > 0)
+        {
+            _is_erasing = event->button() == Qt::RightButton;
+            QRect window = MagicWand::window(_image_size, xyMouse);
+            _magic_wand.start(_pixmap->copy(window).toImage(), window, xyMouse);
+            _wand_press_pos_org = xyMouseOrg;
+            _wand_press_tolerance = _wand_tolerance;
+            update_wand_preview_i();
+        }
+        return;
+    }
+
+    if (_tool == ToolLiveWire)
+    {
+        if (event->button() == Qt::RightButton)
+        {
+            clear_live_wire_i();
+        }
+        else if (event->button() == Qt::LeftButton && _pixmap->size() == _image_size
+            && QRect(QPoint(0, 0), _image_size).contains(xyMouse))
+        {
+            // a new anchor .. the snapped part becomes fixed and the path
+            // continues from its end
+            if (_live_wire.is_active())
+            {
+                update_live_wire_i(xyMouse);
+                _wire_path << _wire_preview.mid(1);
+            }
+            else
+            {
+                _wire_path = QPolygon() << xyMouse;
+            }
+            _wire_preview = QPolygon();
+            QPoint anchor = _wire_path.last();
+            QRect window = LiveWire::window(_image_size, anchor);
+            _live_wire.start(_pixmap->copy(window).toImage(), window, anchor);
+            update(get_wire_rect_org_i());
+        }
+        return;
+    }
+
+    if (_tool == ToolSuperpixels)
+    {
+        // (un)label the whole superpixel under the cursor
+        int label = _superpixels.size() == _image_size ? _superpixels.label(xyMouse) : -1;
+        if ((event->button() == Qt::LeftButton || event->button() == Qt::RightButton)
+            && label >= 0 && _mask_transparency > 0)
+        {
+            _is_erasing = event->button() == Qt::RightButton;
+            QRect bounds = _superpixels.bounds(label);
+            _superpixels.fill(_drawMask, label, get_label_value_i());
+            _is_erasing = false;
+
+            _stroke_rect = bounds;
+            _mask_contours.invalidate(bounds);
+            _mask_pyramid.invalidate(bounds);
+            QRect boundsOrg = _current_matrix.mapRect(QRectF(bounds)).toAlignedRect().adjusted(-1, -1, 1, 1);
+            invalidate_backbuffer_i(boundsOrg);
+            update(boundsOrg);
+            emit( maskChanged( &_drawMask ) );
+        }
+        return;
+    }
+
     if (event->button() == Qt::LeftButton || event->button() == Qt::RightButton)
     {
         // get the region of the mouse cursor
@@ -385,6 +812,10 @@ void PixmapWidget::mousePressEvent(QMouseEvent * event)
             painter.drawPoint(xyMouse);
 
             _is_drawing = true;
+            _stroke_rect = updateRect;
+            _mask_contours.invalidate(updateRect);
+            _mask_pyramid.invalidate(updateRect);
+            invalidate_backbuffer_i(updateRectOrg);
         }
 
         // save the current position and perform an update in the
@@ -420,11 +851,38 @@ void PixmapWidget::mouseMoveEvent(QMouseEvent * event)
     _parent_window->statusBar()->showMessage("Current Image Position is: (" 
         + QString::number(xyMouse.x()) + QString(", ") + QString::number(xyMouse.y()) + QString(")"), 5000);
 
+    if (_tool == ToolMagicWand)
+    {
+        // dragging sideways while the button is down changes the tolerance
+        if (_magic_wand.is_active())
+        {
+            int tolerance = qBound(0, _wand_press_tolerance + (xyMouseOrg.x() - _wand_press_pos_org.x()) / 2, 255);
+            if (tolerance != _wand_tolerance)
+            {
+                _wand_tolerance = tolerance;
+                update_wand_preview_i();
+                emit wandToleranceChanged(tolerance);
+            }
+        }
+        return;
+    }
+
+    if (_tool == ToolLiveWire)
+    {
+        if (_live_wire.is_active())
+            update_live_wire_i(xyMouse);
+        return;
+    }
+
     if (_is_drawing) 
     {
         QPainter painter(&_drawMask);
         setup_current_painter_i(painter);
         painter.drawLine(lastXyMouse, xyMouse);
+        _stroke_rect |= updateRect;
+        _mask_contours.invalidate(updateRect);
+        _mask_pyramid.invalidate(updateRect);
+        invalidate_backbuffer_i(updateRectOrg);
     }
 
     // save the current position and perform an update
@@ -445,6 +903,30 @@ void PixmapWidget::mouseReleaseEvent(QMouseEvent * event)
     QPoint xyMouse = _current_matrix_inv.map(xyMouseOrg);
     QPoint lastXyMouse = _current_matrix_inv.map(lastXyMouseOrg);
 
+    if (_tool == ToolMagicWand)
+    {
+        // write the region into the mask
+        if (_magic_wand.is_active())
+        {
+            QRect bounds = _magic_wand.bounds(_wand_tolerance);
+            _magic_wand.fill(_drawMask, _wand_tolerance, get_label_value_i());
+            _magic_wand.clear();
+            update_wand_preview_i();
+
+            _stroke_rect = bounds;
+            _mask_contours.invalidate(bounds);
+            _mask_pyramid.invalidate(bounds);
+            emit( maskChanged( &_drawMask ) );
+        }
+        _is_erasing = false;
+        return;
+    }
+
+    if (_tool == ToolLiveWire || _tool == ToolSuperpixels)
+    {
+        return;
+    }
+
     // determine the region that has been changed
     QRect updateRectOrg;
     updateRectOrg.setLeft(MIN(lastXyMouseOrg.x(), xyMouseOrg.x()) - (int) ceil(_zoom_factor * (0.5 * _pen_width + 2)));
@@ -458,6 +940,10 @@ void PixmapWidget::mouseReleaseEvent(QMouseEvent * event)
         QPainter painter(&_drawMask);
         setup_current_painter_i(painter);
         painter.drawLine(lastXyMouse, xyMouse);
+        _stroke_rect |= updateRect;
+        _mask_contours.invalidate(updateRect);
+        _mask_pyramid.invalidate(updateRect);
+        invalidate_backbuffer_i(updateRectOrg);
     }
 
     // save the last position
@@ -477,6 +963,43 @@ void PixmapWidget::mouseReleaseEvent(QMouseEvent * event)
     update(updateRectOrg);
 }
 
+void PixmapWidget::mouseDoubleClickEvent(QMouseEvent * event)
+{
+    // the other tools take it as a plain click
+    if (_tool != ToolLiveWire)
+    {
+        mousePressEvent(event);
+        return;
+    }
+    if (!_enable_painting || event->button() != Qt::LeftButton || !_live_wire.is_active())
+    {
+        return;
+    }
+
+    // the first click already set the last anchor .. write the whole path
+    // like a brush stroke
+    update_live_wire_i(_current_matrix_inv.map(event->pos()));
+    _wire_path << _wire_preview.mid(1);
+    if (_mask_transparency > 0)
+    {
+        QPainter painter(&_drawMask);
+        setup_current_painter_i(painter);
+        painter.drawPolyline(_wire_path);
+
+        int penOffset = (int) ceil(0.5 * _pen_width + 2);
+        QRect updateRect = _wire_path.boundingRect().adjusted(-penOffset, -penOffset, penOffset, penOffset);
+        _stroke_rect = updateRect;
+        _mask_contours.invalidate(updateRect);
+        _mask_pyramid.invalidate(updateRect);
+        QRect updateRectOrg = _current_matrix.mapRect(QRectF(updateRect)).toAlignedRect();
+        invalidate_backbuffer_i(updateRectOrg);
+        update(updateRectOrg);
+    }
+    clear_live_wire_i();
+
+    emit( maskChanged( &_drawMask ) );
+}
+
 void PixmapWidget::updateMouseCursor()
 {
 }
@@ -532,6 +1055,7 @@ void PixmapWidget::enable_painting(bool flag)
         setCursor(QCursor(Qt::ArrowCursor));
     }
 
+    invalidate_backbuffer_i();
     update();
 }
 
@@ -540,6 +1064,466 @@ void PixmapWidget::set_confidence(bool flag)
     _is_confident = flag;
 }
 
+void PixmapWidget::set_mask_display_mode(MaskDisplayMode mode)
+{
+    _mask_display_mode = mode;
+    invalidate_backbuffer_i();
+    update();
+}
+
+void PixmapWidget::set_tool(Tool tool)
+{
+    _tool = tool;
+    _magic_wand.clear();
+    update_wand_preview_i();
+    clear_live_wire_i();
+    // the superpixel boundaries come and go with the tool
+    invalidate_backbuffer_i();
+    update();
+}
+
+void PixmapWidget::set_wand_tolerance(int tolerance)
+{
+    if (tolerance == _wand_tolerance)
+        return;
+    _wand_tolerance = tolerance;
+    update_wand_preview_i();
+}
+
+void PixmapWidget::clear_live_wire_i()
+{
+    update(get_wire_rect_org_i());
+    _live_wire.clear();
+    _wire_path = QPolygon();
+    _wire_preview = QPolygon();
+}
+
+void PixmapWidget::update_live_wire_i(const QPoint &xyMouse)
+{
+    // the old and the new path have to be redrawn
+    QRect dirtyOrg = get_wire_rect_org_i();
+    _wire_preview = _live_wire.path(xyMouse);
+    update(dirtyOrg | get_wire_rect_org_i());
+}
+
+QRect PixmapWidget::get_wire_rect_org_i() const
+{
+    QRect rect = _wire_path.boundingRect() | _wire_preview.boundingRect();
+    if (_wire_path.isEmpty())
+        return QRect();
+    return _current_matrix.mapRect(QRectF(rect)).toAlignedRect().adjusted(-2, -2, 2, 2);
+}
+
+QRgb PixmapWidget::get_label_value_i() const
+{
+    // what the brush leaves in the mask (see setup_current_painter_i) .. the
+    // mask is premultiplied
+    if (_is_erasing)
+        return 0;
+
+    QColor rgba(_drawMask.color(_is_confident ? CONFIDENCE_OBJECT : UN_CONFIDENCE_OBJECT));
+    int a = int(_mask_transparency * 255);
+    return qRgba(rgba.red() * a / 255, rgba.green() * a / 255, rgba.blue() * a / 255, a);
+}
+
+void PixmapWidget::update_wand_preview_i()
+{
+    // the pending region in the label colour (half transparent), or darkened
+    // when erasing
+    QRect dirty = _wand_preview_rect;
+    if (_magic_wand.is_active())
+    {
+        QRgb color = qRgba(0, 0, 0, 128);
+        if (!_is_erasing)
+        {
+            QRgb value = get_label_value_i();
+            color = qRgba(qRed(value) / 2, qGreen(value) / 2, qBlue(value) / 2, qAlpha(value) / 2);
+        }
+        _wand_preview = _magic_wand.preview(_wand_tolerance, color);
+        _wand_preview_rect = _magic_wand.bounds(_wand_tolerance);
+    }
+    else
+    {
+        _wand_preview = QImage();
+        _wand_preview_rect = QRect();
+    }
+
+    dirty |= _wand_preview_rect;
+    if (!dirty.isEmpty())
+    {
+        QRect dirtyOrg = _current_matrix.mapRect(QRectF(dirty)).toAlignedRect().adjusted(-1, -1, 1, 1);
+        invalidate_backbuffer_i(dirtyOrg);
+        update(dirtyOrg);
+    }
+}
+
+const QImage &PixmapWidget::get_superpixel_overlay_i(int level)
+{
+    if (!_superpixel_overlay.isNull() && _superpixel_overlay_level == level)
+        return _superpixel_overlay;
+
+    // a pixel of the level is set if any boundary pixel falls into it .. so
+    // the boundaries stay visible when zoomed out
+    const QImage &bits = _superpixels.boundaries();
+    const int w = bits.width();
+    const int h = bits.height();
+    _superpixel_overlay = QImage(((w - 1) >> level) + 1, ((h - 1) >> level) + 1, QImage::Format_ARGB32_Premultiplied);
+    _superpixel_overlay.fill(0);
+    _superpixel_overlay_level = level;
+
+    QRgb color = bits.color(1);
+    int alpha = qAlpha(color);
+    QRgb premultiplied = qRgba(qRed(color) * alpha / 255, qGreen(color) * alpha / 255, qBlue(color) * alpha / 255, alpha);
+    for (int y = 0; y < h; ++y)
+    {
+        const uchar *src = bits.constScanLine(y);
+        QRgb *dst = reinterpret_cast<QRgb *>(_superpixel_overlay.scanLine(y >> level));
+        for (int x = 0; x < w; ++x)
+        {
+            // most of the bytes are empty
+            if (!src[x >> 3])
+                x |= 7;
+            else if (src[x >> 3] & (1 << (x & 7)))
+                dst[x >> level] = premultiplied;
+        }
+    }
+
+    if (_memory_budget)
+        _memory_budget->set_usage(_superpixel_cache, MemoryBudget::image_bytes(_superpixel_overlay));
+    return _superpixel_overlay;
+}
+
+void PixmapWidget::draw_mask_outline_i(QPainter &painter, const QRectF &visible_rect)
+{
+    // draw the cached outlines of the visible tiles instead of the mask image
+    QVector<const QPolygonF *> polylines;
+    _mask_contours.polylines(_drawMask, visible_rect, polylines);
+
+    QColor color(_drawMask.color(CONFIDENCE_OBJECT));
+    color.setAlpha(int(_mask_transparency * 255));
+    QPen pen(color);
+    pen.setWidth(0);
+
+    painter.save();
+    painter.setPen(pen);
+    painter.setBrush(Qt::NoBrush);
+    painter.setRenderHint(QPainter::Antialiasing, false);
+    for (int i = 0; i < polylines.size(); ++i)
+    {
+        painter.drawPolyline(*polylines[i]);
+    }
+    painter.restore();
+
+    // the outlines of newly visible tiles have just been traced
+    if (_memory_budget)
+        _memory_budget->set_usage(_contours_cache, _mask_contours.byte_count());
+}
+
+void PixmapWidget::set_overlay(ImgAnnotation *annotation, IAFileHandle handle)
+{
+    watch_overlay_i(_overlay_annotation, annotation, _lesion_annotation);
+    _overlay_annotation = annotation;
+    _overlay_handle = handle;
+    _overlay_boxes = IAFile();
+    _overlay_items.clear();
+    collect_overlay_items_i(get_overlay_file_i(), 0, INT_MAX, _overlay_items);
+    invalidate_backbuffer_i();
+    update();
+}
+
+void PixmapWidget::set_overlay_boxes(const QList<BoundingBox> &boxes)
+{
+    // keep the boxes as objects of a private file .. so they get drawn
+    // through the same culled path
+    _overlay_boxes = IAFile();
+    _overlay_boxes.reserve(boxes.size());
+    for (int i = 0; i < boxes.size(); ++i)
+    {
+        IAObj obj;
+        obj.box = boxes[i].box;
+        obj.score = boxes[i].score;
+        _overlay_boxes.append(obj, QStringList(), boxes[i].fixPoints);
+    }
+    _overlay_handle = IA_INVALID_HANDLE;
+    _overlay_items.clear();
+    collect_overlay_items_i(get_overlay_file_i(), 0, INT_MAX, _overlay_items);
+    invalidate_backbuffer_i();
+    update();
+}
+
+void PixmapWidget::set_lesion_overlay(ImgAnnotation *annotation, IAFileHandle handle)
+{
+    watch_overlay_i(_lesion_annotation, annotation, _overlay_annotation);
+    _lesion_annotation = annotation;
+    _lesion_handle = handle;
+    _lesion_items.clear();
+    collect_overlay_items_i(get_lesion_file_i(), 0, INT_MAX, _lesion_items);
+    invalidate_backbuffer_i();
+    update();
+}
+
+void PixmapWidget::set_overlay_visible(bool flag)
+{
+    _overlay_visible = flag;
+    invalidate_backbuffer_i();
+    update();
+}
+
+void PixmapWidget::set_overlay_score_threshold(double threshold)
+{
+    _overlay_score_threshold = threshold;
+    invalidate_backbuffer_i();
+    update();
+}
+
+void PixmapWidget::slot_overlay_changed_i()
+{
+    // whole files have been loaded or removed
+    _overlay_items.clear();
+    collect_overlay_items_i(get_overlay_file_i(), 0, INT_MAX, _overlay_items);
+    _lesion_items.clear();
+    collect_overlay_items_i(get_lesion_file_i(), 0, INT_MAX, _lesion_items);
+    invalidate_backbuffer_i();
+    update();
+}
+
+void PixmapWidget::slot_overlay_objects_changed_i(const QString &dir, const QString &file, int first, int last)
+{
+    // only changes of the shown files matter .. and of those only the
+    // objects in the given range
+    const ImgAnnotation *annotation = qobject_cast<const ImgAnnotation *>(sender());
+    if (annotation == NULL)
+    {
+        return;
+    }
+    if (annotation == _overlay_annotation && _overlay_handle != IA_INVALID_HANDLE
+        && annotation->handleDir(_overlay_handle) == dir && annotation->handleFile(_overlay_handle) == file)
+    {
+        invalidate_overlay_i(get_overlay_file_i(), first, last, _overlay_items);
+    }
+    if (annotation == _lesion_annotation && _lesion_handle != IA_INVALID_HANDLE
+        && annotation->handleDir(_lesion_handle) == dir && annotation->handleFile(_lesion_handle) == file)
+    {
+        invalidate_overlay_i(get_lesion_file_i(), first, last, _lesion_items);
+    }
+}
+
+const IAFile *PixmapWidget::get_overlay_file_i() const
+{
+    if (_overlay_annotation && _overlay_handle != IA_INVALID_HANDLE)
+    {
+        return static_cast<const ImgAnnotation *>(_overlay_annotation)->getFile(_overlay_handle);
+    }
+    if (!_overlay_boxes.objects.isEmpty())
+    {
+        return &_overlay_boxes;
+    }
+    return NULL;
+}
+
+const IAFile *PixmapWidget::get_lesion_file_i() const
+{
+    if (_lesion_annotation && _lesion_handle != IA_INVALID_HANDLE)
+    {
+        return static_cast<const ImgAnnotation *>(_lesion_annotation)->getFile(_lesion_handle);
+    }
+    return NULL;
+}
+
+void PixmapWidget::watch_overlay_i(ImgAnnotation *old_annotation, ImgAnnotation *annotation, ImgAnnotation *other)
+{
+    // other is the annotation of the second overlay .. it stays connected
+    if (old_annotation == annotation)
+    {
+        return;
+    }
+    if (old_annotation && old_annotation != other)
+    {
+        disconnect(old_annotation, 0, this, 0);
+    }
+    if (annotation && annotation != other)
+    {
+        connect(annotation, SIGNAL(objectsChanged(const QString &, const QString &, int, int)), this, SLOT(slot_overlay_objects_changed_i(const QString &, const QString &, int, int)));
+        connect(annotation, SIGNAL(filesChanged()), this, SLOT(slot_overlay_changed_i()));
+    }
+}
+
+void PixmapWidget::collect_overlay_items_i(const IAFile *file, int first, int last, QVector<OverlayItem> &items) const
+{
+    if (file == NULL)
+    {
+        return;
+    }
+
+    last = qMin(last, file->objects.size() - 1);
+    for (int i = first; i <= last; ++i)
+    {
+        const IAObj &obj = file->objects[i];
+        // objects without bounds keep a null rect
+        OverlayItem item;
+        file->bounds(i, item.bounds);
+        item.type_id = obj.type.id;
+        item.score = obj.score;
+        items << item;
+    }
+}
+
+void PixmapWidget::invalidate_overlay_i(const IAFile *file, int first, int last, QVector<OverlayItem> &items)
+{
+    // the objects first..last (in the numbering before the change) have
+    // changed .. the ones behind them have only been shifted
+    const int count = file ? file->objects.size() : 0;
+    first = qMax(first, 0);
+    const int old_last = qMin(last, items.size() - 1);
+    const int new_last = qMin(last + count - items.size(), count - 1);
+    QVector<OverlayItem> old_items;
+    if (first <= old_last)
+    {
+        old_items = items.mid(first, old_last - first + 1);
+    }
+    QVector<OverlayItem> new_items;
+    collect_overlay_items_i(file, first, new_last, new_items);
+
+    QVector<OverlayItem> updated = items.mid(0, qMin(first, items.size()));
+    updated << new_items;
+    if (old_last + 1 < items.size())
+    {
+        updated << items.mid(old_last + 1);
+    }
+    items = updated;
+
+    // repaint the objects that are only in one of both .. a removal shifts
+    // the numbering, so they are compared as sorted sets
+    qSort(old_items);
+    qSort(new_items);
+    QVector<QRectF> dirty;
+    int i = 0, j = 0;
+    while (i < old_items.size() || j < new_items.size())
+    {
+        if (j >= new_items.size() || (i < old_items.size() && old_items[i] < new_items[j]))
+        {
+            dirty << old_items[i++].bounds;
+        }
+        else if (i >= old_items.size() || new_items[j] < old_items[i])
+        {
+            dirty << new_items[j++].bounds;
+        }
+        else
+        {
+            ++i;
+            ++j;
+        }
+    }
+
+    if (dirty.size() > OVERLAY_MAX_DIRTY_ITEMS)
+    {
+        invalidate_backbuffer_i();
+        update();
+        return;
+    }
+    for (int k = 0; k < dirty.size(); ++k)
+    {
+        if (dirty[k].isNull())
+        {
+            continue;
+        }
+
+        // with room for the fix point markers, they are a few pixels wide
+        QRect dirtyOrg = _current_matrix.mapRect(dirty[k]).toAlignedRect().adjusted(-4, -4, 4, 4);
+        invalidate_backbuffer_i(dirtyOrg);
+        update(dirtyOrg);
+    }
+}
+
+void PixmapWidget::draw_overlay_i(QPainter &painter, const IAFile *file, const QRectF &visible_rect, double score_threshold)
+{
+    if (!_overlay_visible || file == NULL || file->objects.isEmpty())
+    {
+        return;
+    }
+
+    // only look at the objects in the visible part of the image .. with
+    // some extra space for the fix point markers
+    const double margin = 3.0 / _zoom_factor;
+    QVector<int> visible = file->objectsIn(visible_rect.adjusted(-margin, -margin, margin, margin));
+
+    // collect the primitives per object type .. boxes that are smaller than
+    // a couple of screen pixels are drawn as points
+    QVector<OverlayBatch> batches;
+    QHash<int, int> batch_ids;
+    int last_type_id = -1, last_batch = -1;
+    for (int i = 0; i < visible.size(); ++i)
+    {
+        const int obj_index = visible[i];
+        const IAObj &obj = file->objects[obj_index];
+        if (obj.score < score_threshold)
+        {
+            continue;
+        }
+
+        if (obj.type.id != last_type_id)
+        {
+            QHash<int, int>::const_iterator it = batch_ids.constFind(obj.type.id);
+            if (it == batch_ids.constEnd())
+            {
+                OverlayBatch batch;
+                batch.type_id = obj.type.id;
+                batches << batch;
+                it = batch_ids.insert(obj.type.id, batches.size() - 1);
+            }
+            last_type_id = obj.type.id;
+            last_batch = it.value();
+        }
+        OverlayBatch &batch = batches[last_batch];
+
+        if (!obj.box.isNull())
+        {
+            QRectF box = obj.box.normalized();
+            if (box.width() * _zoom_factor < 2 && box.height() * _zoom_factor < 2)
+            {
+                batch.points << box.center();
+            }
+            else
+            {
+                batch.rects << box;
+            }
+        }
+
+        const QPointF *fix_points = file->fixPointData(obj_index);
+        for (int j = 0; j < obj.fixPoints.count(); ++j)
+        {
+            batch.points << fix_points[j];
+        }
+    }
+
+    // draw each batch with cosmetic pens, i.e., independent of the zoom
+    painter.save();
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.setRenderHint(QPainter::Antialiasing, false);
+    painter.setBrush(Qt::NoBrush);
+    for (int i = 0; i < batches.size(); ++i)
+    {
+        const OverlayBatch &batch = batches[i];
+        QColor color = QColor::fromHsv((batch.type_id * 67) % 360, 255, 255);
+        if (!batch.rects.isEmpty())
+        {
+            QPen pen(color);
+            pen.setWidth(0);
+            painter.setPen(pen);
+            painter.drawRects(batch.rects.constData(), batch.rects.size());
+        }
+        if (!batch.points.isEmpty())
+        {
+            QPen pen(color);
+            pen.setWidth(3);
+            pen.setCosmetic(true);
+            painter.setPen(pen);
+            painter.drawPoints(batch.points.constData(), batch.points.size());
+        }
+    }
+    painter.restore();
+}
+
 void PixmapWidget::updateGL()
 {
     std::cout << "In update GL\n";
@@ -549,4 +1533,8 @@ void PixmapWidget::updateGL()
 void PixmapWidget::resizeGL(int w, int h)
 {
     std::cout << "In resize GL\n";
+
+    // a new view size changes the pan range and possibly the centering
+    update_scroll_bars_i();
+    update_view_matrix_i();
 }
@@ -30,6 +30,14 @@
 #include <QRect>
 #include <QMouseEvent>
 #include <QMatrix>
+#include <QRegion>
+#include "ImgAnnotation.h"
+#include "MaskContours.h"
+#include "MaskPyramid.h"
+#include "MemoryBudget.h"
+#include "MagicWand.h"
+#include "LiveWire.h"
+#include "Superpixels.h"
 
 #define MARGIN 5
 
@@ -47,33 +55,97 @@ public:
 };
 
 
+// an overlay object as it was drawn last .. compared with the current one
+// to repaint only the objects that changed
+class OverlayItem
+{
+public:
+    bool operator<(const OverlayItem &other) const;
+
+public:
+    QRectF bounds;
+    int type_id;
+    double score;
+};
+Q_DECLARE_TYPEINFO(OverlayItem, Q_MOVABLE_TYPE);
+
+
 // our own pixmap widget .. which displays an image and a annotation mask
-class PixmapWidget : public QGLWidget
+class PixmapWidget : public QGLWidget, public MemoryClient
 {
     Q_OBJECT
 
+public:
+    enum MaskDisplayMode { MaskFilled, MaskOutline };
+    enum Tool { ToolBrush, ToolMagicWand, ToolLiveWire, ToolSuperpixels };
+
 public:
     PixmapWidget(QAbstractScrollArea*, QWidget *parent=0);
     virtual ~PixmapWidget();
     const QImage& get_draw_mask() const;
+    QRect get_stroke_rect() const;
 
     void enable_painting(bool flag);
 
-    void set_pixmap(const QPixmap&);
+    void set_pixmap(const QPixmap&, const QSize &image_size = QSize());
+    // the size of the full image, also while only a preview is shown
+    const QSize &get_image_size() const;
     void set_mask(QImage&);
+
+    // an enhanced (gray) version of the image shown instead of it .. it can
+    // be filled in tile by tile, the image shows where it is not ready yet
+    void set_view(const QImage &view);
+    void set_view_tile(const QRect &rect, const QImage &tile);
+    const QImage &get_view() const;
     void set_confidence(bool flag);
 
     void set_pen_width(int width);
     void set_mask_transparency(double transparency);
+    void set_mask_display_mode(MaskDisplayMode mode);
+
+    // the brush paints strokes, the magic wand grows a region from the
+    // clicked pixel (dragging sideways changes the tolerance) and writes it
+    // on release, the live wire snaps a path from the last clicked anchor to
+    // the cursor (a double click writes it at the brush width, the right
+    // button drops it), the superpixel tool labels (left) or unlabels
+    // (right) the whole superpixel under the cursor
+    void set_tool(Tool tool);
+    void set_wand_tolerance(int tolerance);
+    // the superpixels of the image .. their boundaries are shown while the
+    // superpixel tool is selected
+    void set_superpixels(const Superpixels &superpixels);
+
+    // boxes/fix points drawn on top of the image .. either the objects of a
+    // file in an ImgAnnotation or a plain list of bounding boxes
+    void set_overlay(ImgAnnotation *annotation, IAFileHandle handle);
+    void set_overlay_boxes(const QList<BoundingBox> &boxes);
+    // the lesion objects of the image, drawn on top of the overlay .. the
+    // score threshold does not apply to them
+    void set_lesion_overlay(ImgAnnotation *annotation, IAFileHandle handle);
+    void set_overlay_visible(bool flag);
+    void set_overlay_score_threshold(double threshold);
+
+    // registers the image, the mask and their caches at the budget
+    void set_memory_budget(MemoryBudget *budget);
+    virtual qint64 evict(int cache, qint64 bytes);
+
+    // zoom while keeping the image point below anchor (widget coordinates) in place
+    void zoom_at(double factor, const QPoint &anchor);
 
 public slots:
     void slot_zoom_factor_changed(double);
-    
+
+private slots:
+    void slot_overlay_changed_i();
+    void slot_overlay_objects_changed_i(const QString &dir, const QString &file, int first, int last);
+    void slot_scrolled_i();
+
 
 signals:
     void zoomFactorChanged(double);
     void pixmapChanged(QPixmap*);
     void maskChanged(QImage*);
+    void wandToleranceChanged(int);
 
 protected:
     virtual void initializeGL();
@@ -84,18 +156,72 @@ protected:
     void mouseMoveEvent(QMouseEvent * event);
     void mousePressEvent(QMouseEvent * event);
     void mouseReleaseEvent(QMouseEvent * event);
+    void mouseDoubleClickEvent(QMouseEvent * event);
 
 private:
     void updateMouseCursor();
+    void update_scroll_bars_i();
+    void update_view_matrix_i();
     void setup_current_painter_i(QPainter &painter);
+    const IAFile *get_overlay_file_i() const;
+    const IAFile *get_lesion_file_i() const;
+    void watch_overlay_i(ImgAnnotation *old_annotation, ImgAnnotation *annotation, ImgAnnotation *other);
+    void collect_overlay_items_i(const IAFile *file, int first, int last, QVector<OverlayItem> &items) const;
+    void invalidate_overlay_i(const IAFile *file, int first, int last, QVector<OverlayItem> &items);
+    void draw_overlay_i(QPainter &painter, const IAFile *file, const QRectF &visible_rect, double score_threshold);
+    void draw_mask_outline_i(QPainter &painter, const QRectF &visible_rect);
+    const QImage &get_superpixel_overlay_i(int level);
+    void render_backbuffer_i(const QRect &rectOrg);
+    void invalidate_backbuffer_i();
+    void invalidate_backbuffer_i(const QRect &rectOrg);
+    void update_memory_usage_i();
+    QRgb get_label_value_i() const;
+    void update_wand_preview_i();
+    void clear_live_wire_i();
+    void update_live_wire_i(const QPoint &xyMouse);
+    QRect get_wire_rect_org_i() const;
 
 private:
     QPixmap *_pixmap;
+    QSize _image_size;
+    QImage _view;
+    QRegion _view_ready;
     QImage _drawMask;
 
     double _zoom_factor;
     double _mask_transparency;
+    MaskDisplayMode _mask_display_mode;
+    MaskContours _mask_contours;
+    MaskPyramid _mask_pyramid;
     int _pen_width;
+    Tool _tool;
+
+    // the pending region of the magic wand .. shown until the button is released
+    MagicWand _magic_wand;
+    int _wand_tolerance;
+    int _wand_press_tolerance;
+    QPoint _wand_press_pos_org;
+    QImage _wand_preview;
+    QRect _wand_preview_rect;
+
+    // the path of the live wire up to the last anchor and the snapped part
+    // that follows the cursor
+    LiveWire _live_wire;
+    QPolygon _wire_path;
+    QPolygon _wire_preview;
+
+    Superpixels _superpixels;
+    // the boundaries expanded to ARGB and pooled down to the mask pyramid
+    // level they were last drawn at
+    QImage _superpixel_overlay;
+    int _superpixel_overlay_level;
+
+    // the composited view without the brush .. panning only moves it and
+    // renders the newly exposed strips
+    QImage _backbuffer;
+    QPoint _backbuffer_origin;
+    QRegion _backbuffer_dirty;
+    bool _backbuffer_valid;
 
     QMatrix _current_matrix_inv;
     QMatrix _current_matrix;
@@ -106,15 +232,33 @@ private:
     QPoint xyMouseFollowed;
 
     bool _is_drawing;
+    QRect _stroke_rect;
 
-    double _last_v_scroll_value;
-    double _last_h_scroll_value;
     QAbstractScrollArea *_scroll_area;
     QMainWindow *_parent_window;
 
     bool _enable_painting;
     bool _is_confident;
     bool _is_erasing;
+
+    MemoryBudget *_memory_budget;
+    int _image_cache;
+    int _mask_cache;
+    int _backbuffer_cache;
+    int _pyramid_cache;
+    int _contours_cache;
+    int _superpixel_cache;
+
+    ImgAnnotation *_overlay_annotation;
+    IAFileHandle _overlay_handle;
+    IAFile _overlay_boxes;
+    ImgAnnotation *_lesion_annotation;
+    IAFileHandle _lesion_handle;
+    // the objects of both as they were drawn last
+    QVector<OverlayItem> _overlay_items;
+    QVector<OverlayItem> _lesion_items;
+    bool _overlay_visible;
+    double _overlay_score_threshold;
 };
 
 #endif // PIXMAPWIDGET_H
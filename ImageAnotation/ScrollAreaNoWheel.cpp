@@ -21,9 +21,34 @@
 */
 #include "ScrollAreaNoWheel.h"
 
-ScrollAreaNoWheel::ScrollAreaNoWheel(QWidget *parent) : QScrollArea( parent )
+ScrollAreaNoWheel::ScrollAreaNoWheel(QWidget *parent) : QAbstractScrollArea( parent )
 {
+    _widget = NULL;
     setFocusPolicy(Qt::NoFocus);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
+}
+
+void ScrollAreaNoWheel::set_widget(QWidget *widget)
+{
+    // the widget is not scrolled as a whole .. it simply covers the viewport
+    _widget = widget;
+    _widget->setParent(viewport());
+    _widget->setGeometry(viewport()->rect());
+    _widget->show();
+}
+
+QWidget *ScrollAreaNoWheel::widget() const
+{
+    return _widget;
+}
+
+void ScrollAreaNoWheel::resizeEvent(QResizeEvent *event)
+{
+    // we get the resize events of the viewport here
+    QAbstractScrollArea::resizeEvent(event);
+    if (_widget)
+        _widget->setGeometry(viewport()->rect());
 }
 
 void ScrollAreaNoWheel::wheelEvent(QWheelEvent *event)
@@ -22,23 +22,32 @@
 #ifndef ScrollAreaNoWheel_H
 #define ScrollAreaNoWheel_H
 
-#include <QScrollArea>
+#include <QAbstractScrollArea>
 #include <QWheelEvent>
+#include <QResizeEvent>
 
 // defines our own ScrollArea which behaves a bit more special
-// in the way that it will ignore QWheelEvents
-class ScrollAreaNoWheel : public QScrollArea
+// in the way that it will ignore QWheelEvents .. the widget always fills
+// the viewport and drives the scroll bars itself (it owns pan and zoom)
+class ScrollAreaNoWheel : public QAbstractScrollArea
 {
     Q_OBJECT
 
 public:
     ScrollAreaNoWheel(QWidget *parent=0);
 
+    void set_widget(QWidget *widget);
+    QWidget *widget() const;
+
 protected:
     void wheelEvent(QWheelEvent *);
+    void resizeEvent(QResizeEvent *);
 
 signals:
     void wheelTurned(QWheelEvent *);
+
+private:
+    QWidget *_widget;
 };
 
 
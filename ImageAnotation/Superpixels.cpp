@@ -0,0 +1,418 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "Superpixels.h"
+
+#include <float.h>
+#include <string.h>
+#include <QRunnable>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QByteArray>
+#include <QtDebug>
+
+namespace
+{
+    // "SPX1" .. first word of the cache files
+    const quint32 SUPERPIXEL_FILE_MAGIC = 0x53505831;
+
+    class Center
+    {
+    public:
+        float x, y;
+        float r, g, b;
+    };
+}
+
+
+// ========== Superpixels ==========
+
+Superpixels::Superpixels()
+{
+    _count = 0;
+}
+
+bool Superpixels::is_empty() const
+{
+    return _count == 0;
+}
+
+QSize Superpixels::size() const
+{
+    return _size;
+}
+
+int Superpixels::count() const
+{
+    return _count;
+}
+
+int Superpixels::label(const QPoint &pos) const
+{
+    if (pos.x() < 0 || pos.y() < 0 || pos.x() >= _size.width() || pos.y() >= _size.height())
+        return -1;
+    return _labels[pos.y() * _size.width() + pos.x()];
+}
+
+QRect Superpixels::bounds(int label) const
+{
+    if (label < 0 || label >= _count)
+        return QRect();
+    return _bounds[label];
+}
+
+const QImage &Superpixels::boundaries() const
+{
+    return _boundaries;
+}
+
+void Superpixels::fill(QImage &mask, int label, QRgb value) const
+{
+    QRect rect = bounds(label) & mask.rect();
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        const int *labels = _labels.constData() + y * _size.width() + rect.x();
+        QRgb *line = reinterpret_cast<QRgb *>(mask.scanLine(y)) + rect.x();
+        for (int x = 0; x < rect.width(); ++x) {
+            if (labels[x] == label)
+                line[x] = value;
+        }
+    }
+}
+
+qint64 Superpixels::byte_count() const
+{
+    return qint64(_labels.size()) * sizeof(int) + qint64(_bounds.size()) * sizeof(QRect)
+        + qint64(_boundaries.bytesPerLine()) * _boundaries.height();
+}
+
+Superpixels Superpixels::compute(const QImage &image, const volatile int &run, int current)
+{
+    QImage picture = image;
+    if (picture.format() != QImage::Format_RGB32 && picture.format() != QImage::Format_ARGB32 && picture.format() != QImage::Format_ARGB32_Premultiplied)
+        picture = picture.convertToFormat(QImage::Format_RGB32);
+    const int w = picture.width();
+    const int h = picture.height();
+    const int n = w * h;
+    const int S = SUPERPIXEL_SIZE;
+    if (n == 0)
+        return Superpixels();
+
+    // the centers start on a regular grid
+    QVector<Center> centers;
+    for (int y = qMin(S / 2, h - 1); y < h; y += S) {
+        for (int x = qMin(S / 2, w - 1); x < w; x += S) {
+            QRgb rgb = picture.pixel(x, y);
+            Center center;
+            center.x = x;
+            center.y = y;
+            center.r = qRed(rgb);
+            center.g = qGreen(rgb);
+            center.b = qBlue(rgb);
+            centers.append(center);
+        }
+    }
+
+    // each pixel goes to the closest center (colour and scaled distance)
+    // within 2S x 2S around it, then the centers move to the mean of their
+    // pixels
+    QVector<int> labels(n, 0);
+    QVector<float> distances(n);
+    const float ratio = float(SUPERPIXEL_COMPACTNESS * SUPERPIXEL_COMPACTNESS) / (S * S);
+    for (int iteration = 0; iteration < SUPERPIXEL_ITERATIONS; ++iteration) {
+        if (run != current)
+            return Superpixels();
+
+        distances.fill(FLT_MAX);
+        for (int k = 0; k < centers.size(); ++k) {
+            const Center &c = centers[k];
+            int x0 = qMax(0, int(c.x) - S), x1 = qMin(w - 1, int(c.x) + S);
+            int y0 = qMax(0, int(c.y) - S), y1 = qMin(h - 1, int(c.y) + S);
+            for (int y = y0; y <= y1; ++y) {
+                const QRgb *line = reinterpret_cast<const QRgb *>(picture.constScanLine(y));
+                float *d = distances.data() + y * w;
+                int *l = labels.data() + y * w;
+                float dy2 = (y - c.y) * (y - c.y);
+                for (int x = x0; x <= x1; ++x) {
+                    float dr = qRed(line[x]) - c.r;
+                    float dg = qGreen(line[x]) - c.g;
+                    float db = qBlue(line[x]) - c.b;
+                    float dist = dr * dr + dg * dg + db * db + ((x - c.x) * (x - c.x) + dy2) * ratio;
+                    if (dist < d[x]) {
+                        d[x] = dist;
+                        l[x] = k;
+                    }
+                }
+            }
+        }
+
+        QVector<double> sums(centers.size() * 6, 0.0);
+        for (int y = 0; y < h; ++y) {
+            const QRgb *line = reinterpret_cast<const QRgb *>(picture.constScanLine(y));
+            const int *l = labels.constData() + y * w;
+            for (int x = 0; x < w; ++x) {
+                double *sum = sums.data() + l[x] * 6;
+                sum[0] += x;
+                sum[1] += y;
+                sum[2] += qRed(line[x]);
+                sum[3] += qGreen(line[x]);
+                sum[4] += qBlue(line[x]);
+                sum[5] += 1;
+            }
+        }
+        for (int k = 0; k < centers.size(); ++k) {
+            const double *sum = sums.constData() + k * 6;
+            if (sum[5] == 0)
+                continue;
+            centers[k].x = sum[0] / sum[5];
+            centers[k].y = sum[1] / sum[5];
+            centers[k].r = sum[2] / sum[5];
+            centers[k].g = sum[3] / sum[5];
+            centers[k].b = sum[4] / sum[5];
+        }
+    }
+
+    // the clusters are not necessarily connected .. every connected piece
+    // becomes a superpixel of its own, small ones are merged into the
+    // superpixel left of (or above) them
+    Superpixels result;
+    result._size = picture.size();
+    result._labels = QVector<int>(n, -1);
+    int *final_labels = result._labels.data();
+    const int min_size = S * S / 4;
+    int count = 0;
+    QVector<int> component;
+    for (int i = 0; i < n; ++i) {
+        if (final_labels[i] >= 0)
+            continue;
+        int adjacent = -1;
+        if (i % w > 0)
+            adjacent = final_labels[i - 1];
+        else if (i >= w)
+            adjacent = final_labels[i - w];
+
+        component.clear();
+        component.append(i);
+        final_labels[i] = count;
+        for (int j = 0; j < component.size(); ++j) {
+            int p = component[j];
+            int x = p % w, y = p / w;
+            int neighbours[4];
+            int m = 0;
+            if (x > 0)
+                neighbours[m++] = p - 1;
+            if (x < w - 1)
+                neighbours[m++] = p + 1;
+            if (y > 0)
+                neighbours[m++] = p - w;
+            if (y < h - 1)
+                neighbours[m++] = p + w;
+            for (int k = 0; k < m; ++k) {
+                int q = neighbours[k];
+                if (final_labels[q] < 0 && labels[q] == labels[i]) {
+                    final_labels[q] = count;
+                    component.append(q);
+                }
+            }
+        }
+
+        if (component.size() < min_size && adjacent >= 0) {
+            for (int j = 0; j < component.size(); ++j)
+                final_labels[component[j]] = adjacent;
+        }
+        else {
+            count++;
+        }
+    }
+    result._count = count;
+    result.finish_i();
+    return result;
+}
+
+QString Superpixels::cache_file(const QString &image_file)
+{
+    return image_file + SUPERPIXEL_FILE_SUFFIX;
+}
+
+Superpixels Superpixels::load(const QString &image_file)
+{
+    QFileInfo info(image_file);
+    QFile file(cache_file(image_file));
+    if (!file.open(QIODevice::ReadOnly))
+        return Superpixels();
+
+    // written for another version of the image .. computed again
+    QDataStream in(&file);
+    quint32 magic;
+    qint64 bytes, mtime;
+    qint32 w, h, count;
+    in >> magic >> bytes >> mtime >> w >> h >> count;
+    if (in.status() != QDataStream::Ok || magic != SUPERPIXEL_FILE_MAGIC
+        || bytes != info.size() || mtime != info.lastModified().toMSecsSinceEpoch()
+        || w <= 0 || h <= 0 || count <= 0)
+        return Superpixels();
+
+    QByteArray data;
+    in >> data;
+    QByteArray raw = qUncompress(data);
+    if (raw.size() != int(w * h * sizeof(int)))
+        return Superpixels();
+
+    Superpixels result;
+    result._size = QSize(w, h);
+    result._count = count;
+    result._labels.resize(w * h);
+    memcpy(result._labels.data(), raw.constData(), raw.size());
+    for (int i = 0; i < result._labels.size(); ++i) {
+        if (result._labels[i] < 0 || result._labels[i] >= count)
+            return Superpixels();
+    }
+    result.finish_i();
+    return result;
+}
+
+bool Superpixels::save(const QString &image_file) const
+{
+    QFileInfo info(image_file);
+    QFile file(cache_file(image_file));
+    if (is_empty() || !file.open(QIODevice::WriteOnly))
+        return false;
+
+    // the labels are stored as they are in memory (a local cache only)
+    QDataStream out(&file);
+    out << SUPERPIXEL_FILE_MAGIC << qint64(info.size()) << qint64(info.lastModified().toMSecsSinceEpoch())
+        << qint32(_size.width()) << qint32(_size.height()) << qint32(_count);
+    QByteArray raw = QByteArray::fromRawData(reinterpret_cast<const char *>(_labels.constData()), _labels.size() * sizeof(int));
+    out << qCompress(raw, 1);
+    return out.status() == QDataStream::Ok;
+}
+
+void Superpixels::finish_i()
+{
+    // the bounding rects and the boundaries .. a pixel is on a boundary if
+    // its right or lower neighbour belongs to another superpixel
+    const int w = _size.width();
+    const int h = _size.height();
+    QVector<int> minX(_count, w), maxX(_count, -1), minY(_count, h), maxY(_count, -1);
+
+    QVector<QRgb> table;
+    table << qRgba(0, 0, 0, 0) << qRgba(255, 255, 0, 160);
+    _boundaries = QImage(_size, QImage::Format_MonoLSB);
+    _boundaries.setColorTable(table);
+    _boundaries.fill(0);
+
+    for (int y = 0; y < h; ++y) {
+        const int *labels = _labels.constData() + y * w;
+        uchar *line = _boundaries.scanLine(y);
+        for (int x = 0; x < w; ++x) {
+            int label = labels[x];
+            minX[label] = qMin(minX[label], x);
+            maxX[label] = qMax(maxX[label], x);
+            minY[label] = qMin(minY[label], y);
+            maxY[label] = qMax(maxY[label], y);
+            if ((x < w - 1 && labels[x + 1] != label) || (y < h - 1 && labels[x + w] != label))
+                line[x >> 3] |= uchar(1 << (x & 7));
+        }
+    }
+
+    _bounds.resize(_count);
+    for (int i = 0; i < _count; ++i) {
+        if (maxX[i] >= 0)
+            _bounds[i] = QRect(QPoint(minX[i], minY[i]), QPoint(maxX[i], maxY[i]));
+    }
+}
+
+
+// ========== SuperpixelTask ==========
+
+// the superpixels of one image .. from the cache file if it is up to date,
+// otherwise computed and written. the result is sent back with a queued
+// call
+class SuperpixelTask : public QRunnable
+{
+public:
+    SuperpixelTask(SuperpixelLoader *loader, int run, const QString &file, const QImage &picture)
+        : _loader(loader), _run(run), _file(file), _picture(picture) {}
+
+    void run()
+    {
+        // the user already moved on to another image
+        if (_loader->_run != _run)
+            return;
+
+        Superpixels superpixels = Superpixels::load(_file);
+        if (superpixels.size() != _picture.size())
+        {
+            superpixels = Superpixels::compute(_picture, _loader->_run, _run);
+            if (!superpixels.is_empty() && !superpixels.save(_file))
+                qWarning() << "Superpixels: could not write" << Superpixels::cache_file(_file);
+        }
+
+        QMetaObject::invokeMethod(_loader, "slot_superpixels_done_i", Qt::QueuedConnection,
+            Q_ARG(int, _run), Q_ARG(QString, _file), Q_ARG(Superpixels, superpixels));
+    }
+
+private:
+    SuperpixelLoader *_loader;
+    int _run;
+    QString _file;
+    QImage _picture;
+};
+
+
+// ========== SuperpixelLoader ==========
+
+SuperpixelLoader::SuperpixelLoader(QObject *parent)
+    : QObject(parent)
+{
+    // one image at a time .. a newer request makes the queued ones obsolete
+    qRegisterMetaType<Superpixels>("Superpixels");
+    _pool.setMaxThreadCount(1);
+    _run = 0;
+}
+
+SuperpixelLoader::~SuperpixelLoader()
+{
+    cancel();
+    _pool.waitForDone();
+}
+
+void SuperpixelLoader::start(const QString &file, const QImage &picture)
+{
+    _run++;
+    _pool.start(new SuperpixelTask(this, _run, file, picture));
+}
+
+void SuperpixelLoader::cancel()
+{
+    // does not block .. the computation running gives up after its current
+    // iteration
+    _run++;
+}
+
+void SuperpixelLoader::slot_superpixels_done_i(int run, const QString &file, const Superpixels &superpixels)
+{
+    if (run != _run || superpixels.is_empty())
+        return;
+
+    emit loaded(file, superpixels);
+}
@@ -0,0 +1,112 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef Superpixels_H
+#define Superpixels_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QRect>
+#include <QSize>
+#include <QImage>
+#include <QMetaType>
+#include <QThreadPool>
+
+// edge length (pixels) of the superpixels SLIC starts with
+#define SUPERPIXEL_SIZE 32
+// weight of the distance against the colour difference
+#define SUPERPIXEL_COMPACTNESS 10
+#define SUPERPIXEL_ITERATIONS 5
+// the cache file next to the image is named <image file><suffix>
+#define SUPERPIXEL_FILE_SUFFIX ".spx"
+
+
+// the superpixel label of every pixel of an image .. with the bounding
+// rect of each superpixel and an image of their boundaries, both built once
+// when the labels are computed or read
+class Superpixels
+{
+public:
+    Superpixels();
+
+    bool is_empty() const;
+    QSize size() const;
+    int count() const;
+    // -1 outside of the image
+    int label(const QPoint &pos) const;
+    QRect bounds(int label) const;
+    // set pixels on the boundaries (1 bit, transparent elsewhere)
+    const QImage &boundaries() const;
+    // sets the pixels of a superpixel in mask to value
+    void fill(QImage &mask, int label, QRgb value) const;
+    qint64 byte_count() const;
+
+    // SLIC (in RGB) .. gives up with an empty result as soon as run is not
+    // current any more
+    static Superpixels compute(const QImage &picture, const volatile int &run, int current);
+    // the cache file of an image .. it is only taken if the image did not
+    // change since it was written
+    static QString cache_file(const QString &image_file);
+    static Superpixels load(const QString &image_file);
+    bool save(const QString &image_file) const;
+
+private:
+    void finish_i();
+
+private:
+    QSize _size;
+    int _count;
+    QVector<int> _labels;
+    QVector<QRect> _bounds;
+    QImage _boundaries;
+};
+Q_DECLARE_METATYPE(Superpixels)
+
+
+// reads the superpixels of an image from its cache file or computes (and
+// writes) them on a worker thread
+class SuperpixelLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    SuperpixelLoader(QObject *parent = 0);
+    virtual ~SuperpixelLoader();
+
+    // file is the image file, picture its decoded image
+    void start(const QString &file, const QImage &picture);
+    void cancel();
+
+signals:
+    void loaded(const QString &file, const Superpixels &superpixels);
+
+private slots:
+    void slot_superpixels_done_i(int run, const QString &file, const Superpixels &superpixels);
+
+private:
+    friend class SuperpixelTask;
+
+    QThreadPool _pool;
+    volatile int _run;
+};
+
+#endif
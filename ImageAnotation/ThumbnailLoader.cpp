@@ -0,0 +1,182 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include "ThumbnailLoader.h"
+
+#include <QImageReader>
+#include <QFileInfo>
+#include <QDir>
+#include <QFile>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QDesktopServices>
+#include <QRunnable>
+
+
+// ========== ThumbnailTask ==========
+
+// reads the thumbnail of one image from the cache or creates it .. the
+// result is sent back to the loader with a queued call
+class ThumbnailTask : public QRunnable
+{
+public:
+    ThumbnailTask(ThumbnailLoader *loader, int run, const QString &file)
+        : _loader(loader), _run(run), _file(file) {}
+
+    void run()
+    {
+        // the view has been scrolled on meanwhile
+        if (_loader->_run != _run)
+            return;
+
+        QString cached = _loader->_cache_dir + "/" + ThumbnailLoader::cache_file(_file);
+        QImage thumbnail(cached);
+        if (thumbnail.isNull()) {
+            QImageReader reader(_file);
+            QSize size = reader.size();
+            if (size.isValid()) {
+                size.scale(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio);
+                reader.setScaledSize(size);
+            }
+            thumbnail = reader.read();
+            if (!thumbnail.isNull() && (thumbnail.width() > THUMBNAIL_SIZE || thumbnail.height() > THUMBNAIL_SIZE))
+                thumbnail = thumbnail.scaled(THUMBNAIL_SIZE, THUMBNAIL_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            if (!thumbnail.isNull())
+                thumbnail.save(cached, "JPG", 85);
+        }
+
+        QMetaObject::invokeMethod(_loader, "slot_thumbnail_done_i", Qt::QueuedConnection,
+            Q_ARG(int, _run), Q_ARG(QString, _file), Q_ARG(QImage, thumbnail));
+    }
+
+private:
+    ThumbnailLoader *_loader;
+    int _run;
+    QString _file;
+};
+
+
+// ========== ThumbnailLoader ==========
+
+ThumbnailLoader::ThumbnailLoader(MemoryBudget *budget, QObject *parent)
+    : QObject(parent)
+{
+    _run = 0;
+    _bytes = 0;
+    _cache_dir = cache_dir();
+    QDir().mkpath(_cache_dir);
+
+    _budget = budget;
+    _cache = _budget->add_cache("Thumbnails", MemoryBudget::Low, this);
+}
+
+ThumbnailLoader::~ThumbnailLoader()
+{
+    cancel();
+    _pool.waitForDone();
+    _budget->remove_cache(_cache);
+}
+
+QString ThumbnailLoader::cache_dir()
+{
+    QString dir = QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+    if (dir.isEmpty())
+        dir = QDir::tempPath();
+    return dir + "/ImageAnotation/thumbnails";
+}
+
+QString ThumbnailLoader::cache_file(const QString &file)
+{
+    // a changed image gets a new name .. stale thumbnails are never read
+    QFileInfo info(file);
+    QString key = info.absoluteFilePath() + "|" + QString::number(info.lastModified().toMSecsSinceEpoch())
+        + "|" + QString::number(info.size());
+    return QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5).toHex() + ".jpg";
+}
+
+QImage ThumbnailLoader::thumbnail(const QString &file)
+{
+    if (!_thumbnails.contains(file))
+        return QImage();
+
+    _order.removeOne(file);
+    _order.prepend(file);
+    return _thumbnails[file];
+}
+
+void ThumbnailLoader::request(const QStringList &files)
+{
+    // a request replaces the earlier ones .. files come in the order they
+    // should be done, i.e., visible ones first
+    _run++;
+    _pending.clear();
+    for (int i = 0; i < files.size(); ++i) {
+        if (_thumbnails.contains(files[i]) || _pending.contains(files[i]))
+            continue;
+        _pending.insert(files[i], true);
+        _pool.start(new ThumbnailTask(this, _run, files[i]), -i);
+    }
+}
+
+void ThumbnailLoader::cancel()
+{
+    // does not block .. queued tasks are skipped
+    _run++;
+    _pending.clear();
+}
+
+qint64 ThumbnailLoader::evict(int, qint64 bytes)
+{
+    // the least recently used thumbnails first
+    qint64 target = _bytes - bytes;
+    while (!_order.isEmpty() && _bytes > target)
+        drop_i();
+    return _bytes;
+}
+
+void ThumbnailLoader::slot_thumbnail_done_i(int run, const QString &file, const QImage &thumbnail)
+{
+    if (run != _run)
+        return;
+    _pending.remove(file);
+    if (thumbnail.isNull())
+        return;
+
+    insert_i(file, thumbnail);
+    _budget->set_usage(_cache, _bytes);
+    emit thumbnail_ready(file, thumbnail);
+}
+
+void ThumbnailLoader::insert_i(const QString &file, const QImage &thumbnail)
+{
+    _thumbnails.insert(file, thumbnail);
+    _order.prepend(file);
+    _bytes += MemoryBudget::image_bytes(thumbnail);
+    while (_order.size() > THUMBNAIL_MEMORY_COUNT)
+        drop_i();
+}
+
+void ThumbnailLoader::drop_i()
+{
+    QString file = _order.takeLast();
+    _bytes -= MemoryBudget::image_bytes(_thumbnails[file]);
+    _thumbnails.remove(file);
+}
@@ -0,0 +1,87 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#ifndef ThumbnailLoader_H
+#define ThumbnailLoader_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QImage>
+#include <QHash>
+#include <QList>
+#include <QThreadPool>
+#include "MemoryBudget.h"
+
+// longest side of the thumbnails
+#define THUMBNAIL_SIZE 64
+// thumbnails kept in memory at most
+#define THUMBNAIL_MEMORY_COUNT 2000
+
+
+// creates thumbnails of images on a thread pool .. they are decoded
+// reduced where the format supports it and stored in a cache directory,
+// keyed by path, mtime and size of the image, so the next session only
+// reads the small files
+class ThumbnailLoader : public QObject, public MemoryClient
+{
+    Q_OBJECT
+
+public:
+    ThumbnailLoader(MemoryBudget *budget, QObject *parent = 0);
+    virtual ~ThumbnailLoader();
+
+    static QString cache_dir();
+    static QString cache_file(const QString &file);
+
+    QImage thumbnail(const QString &file);
+    void request(const QStringList &files);
+    void cancel();
+
+    virtual qint64 evict(int cache, qint64 bytes);
+
+signals:
+    void thumbnail_ready(const QString &file, const QImage &thumbnail);
+
+private slots:
+    void slot_thumbnail_done_i(int run, const QString &file, const QImage &thumbnail);
+
+private:
+    void insert_i(const QString &file, const QImage &thumbnail);
+    void drop_i();
+
+private:
+    friend class ThumbnailTask;
+
+    MemoryBudget *_budget;
+    int _cache;
+    QThreadPool _pool;
+    volatile int _run;
+    QString _cache_dir;
+
+    QHash<QString, QImage> _thumbnails;
+    // most recently used first
+    QList<QString> _order;
+    QHash<QString, bool> _pending;
+    qint64 _bytes;
+};
+
+#endif
@@ -34,6 +34,16 @@
 #include <QMessageBox>
 #include <QImageReader>
 #include <QTextCodec>
+#include <QTimer>
+#include <QLabel>
+#include <QInputDialog>
+#include <QSettings>
+#include <QCoreApplication>
+#include <QScrollBar>
+#include <QIcon>
+#include <QFileSystemWatcher>
+#include <QFileInfo>
+#include <QDateTime>
 
 #include "defines.h"
 
@@ -89,9 +99,63 @@ MainWindow::MainWindow(QWidget *parent, QFlag flags)
     _scroll_area = new ScrollAreaNoWheel(this);
     _pixmap_widget = new PixmapWidget(_scroll_area, this);
     
-    _scroll_area->setWidgetResizable(true);
-    _scroll_area->setWidget(_pixmap_widget);
+    _scroll_area->set_widget(_pixmap_widget);
     setCentralWidget(_scroll_area);
+    _mask_index = new MaskIndex(this);
+    _annotation = new ImgAnnotation();
+    _annotation->setParent(this);
+    _lesions = new ImgAnnotation();
+    _lesions->setParent(this);
+    _component_extractor = new MaskComponentExtractor(_lesions, this);
+    _image_loader = new ImageLoader(this);
+    _image_enhancer = new ImageEnhancer(this);
+    connect(_image_enhancer, SIGNAL(tile_ready(const QString &, int, const QRect &, const QImage &)), this, SLOT(slot_view_tile_ready_i(const QString &, int, const QRect &, const QImage &)));
+    connect(_image_enhancer, SIGNAL(finished(const QString &, int)), this, SLOT(slot_view_finished_i(const QString &, int)));
+    _superpixel_loader = new SuperpixelLoader(this);
+    connect(_superpixel_loader, SIGNAL(loaded(const QString &, const Superpixels &)), this, SLOT(slot_superpixels_loaded_i(const QString &, const Superpixels &)));
+
+    // the image list .. filled lazily from sorted per directory arrays
+    _image_model = new ImageTreeModel(this);
+    imgTreeView->setModel(_image_model);
+    connect(imgTreeView->selectionModel(), SIGNAL(currentChanged(const QModelIndex &, const QModelIndex &)), this, SLOT(slot_current_image_changed_i(const QModelIndex &, const QModelIndex &)));
+
+    // everything large is accounted here .. the ceiling is kept in the settings
+    QSettings settings("lear", "ImageAnotation");
+    int limit_mb = settings.value("memory_limit_mb", MEMORY_BUDGET_DEFAULT_MB).toInt();
+    _memory_budget = new MemoryBudget(qint64(limit_mb) << 20, this);
+    _memory_label = new QLabel(this);
+    statusBar()->addPermanentWidget(_memory_label);
+    connect(_memory_budget, SIGNAL(usage_changed(qint64, qint64)), this, SLOT(slot_memory_usage_changed_i(qint64, qint64)));
+    _undo_cache = _memory_budget->add_cache("Undo history", MemoryBudget::Normal, this);
+    _pixmap_widget->set_memory_budget(_memory_budget);
+    _working_set = new MaskWorkingSet(_memory_budget, this);
+    connect(_working_set, SIGNAL(flush_failed(const QString &)), this, SLOT(slot_mask_flush_failed_i(const QString &)));
+    connect(_working_set, SIGNAL(layer_written(const QString &, int)), _mask_index, SLOT(update_mtime(const QString &, int)));
+
+    // thumbnails of the visible part of the image tree .. updated a moment
+    // after scrolling stopped
+    _thumbnail_loader = new ThumbnailLoader(_memory_budget, this);
+    _thumbnail_timer = new QTimer(this);
+    _thumbnail_timer->setSingleShot(true);
+    _thumbnail_timer->setInterval(100);
+    connect(_thumbnail_timer, SIGNAL(timeout()), this, SLOT(slot_update_thumbnails_i()));
+    connect(_thumbnail_loader, SIGNAL(thumbnail_ready(const QString &, const QImage &)), this, SLOT(slot_thumbnail_ready_i(const QString &, const QImage &)));
+    connect(imgTreeView->verticalScrollBar(), SIGNAL(valueChanged(int)), _thumbnail_timer, SLOT(start()));
+    connect(imgTreeView, SIGNAL(expanded(const QModelIndex &)), _thumbnail_timer, SLOT(start()));
+    connect(imgTreeView, SIGNAL(collapsed(const QModelIndex &)), _thumbnail_timer, SLOT(start()));
+
+    // changes in the opened directories are collected for a moment .. bulk
+    // copies end up in one update of the tree
+    _dir_watcher = new QFileSystemWatcher(this);
+    _dir_timer = new QTimer(this);
+    _dir_timer->setSingleShot(true);
+    _dir_timer->setInterval(1000);
+    connect(_dir_watcher, SIGNAL(directoryChanged(const QString &)), this, SLOT(slot_directory_changed_i(const QString &)));
+    connect(_dir_timer, SIGNAL(timeout()), this, SLOT(slot_apply_directory_changes_i()));
+    _components_class = -1;
+    _filter_timer = new QTimer(this);
+    _filter_timer->setSingleShot(true);
+    _filter_timer->setInterval(300);
     _is_key_shift_pressed = false;
     _is_key_ctrl_pressed = false;
 
@@ -116,7 +180,15 @@ MainWindow::MainWindow(QWidget *parent, QFlag flags)
     connect(_pixmap_widget, SIGNAL(maskChanged(QImage *)), this, SLOT(slot_mask_draw_i(QImage *)));
     connect(zoomSpinBox, SIGNAL(valueChanged(double)), _pixmap_widget, SLOT(slot_zoom_factor_changed(double)));
     connect(_pixmap_widget, SIGNAL(zoomFactorChanged(double)), zoomSpinBox, SLOT(setValue(double)));
+    connect(_pixmap_widget, SIGNAL(wandToleranceChanged(int)), wandToleranceSlider, SLOT(setValue(int)));
+    _pixmap_widget->set_wand_tolerance(wandToleranceSlider->value());
     connect(_scroll_area, SIGNAL(wheelTurned(QWheelEvent*)), this, SLOT(slot_wheel_turned_in_scroll_area_i(QWheelEvent *)));
+    connect(_mask_index, SIGNAL(image_indexed(const QString &)), _filter_timer, SLOT(start()));
+    connect(_mask_index, SIGNAL(scan_finished()), _filter_timer, SLOT(start()));
+    connect(_filter_timer, SIGNAL(timeout()), this, SLOT(slot_apply_img_tree_filter_i()));
+    connect(_component_extractor, SIGNAL(progress(int, int)), this, SLOT(slot_extraction_progress_i(int, int)));
+    connect(_component_extractor, SIGNAL(finished()), this, SLOT(slot_extraction_finished_i()));
+    connect(_image_loader, SIGNAL(loaded(const QString &, const QImage &)), this, SLOT(slot_image_loaded_i(const QString &, const QImage &)));
 
     // set some default values
     brushSizeComboBox->setCurrentIndex(1);
@@ -137,44 +209,55 @@ MainWindow::MainWindow(QWidget *parent, QFlag flags)
         tr("")
     };
 
+    // the built in classes .. replaced by the schema file if there is one
+    for (int i = 0; i < MASK_TPYE_NUM; ++i)
+        _mask_classes.add(QString(S_mask_types[i].c_str()), mask_type_tool_tips[i]);
+    QString schema_file = settings.value("mask_class_schema", QCoreApplication::applicationDirPath() + "/" + MASK_CLASS_SCHEMA_FILE).toString();
+    if (_mask_classes.load(schema_file))
+        statusBar()->showMessage("Loaded " + QString::number(_mask_classes.count()) + " mask classes from " + schema_file, 5 * 1000);
+
     objTypeComboBox->setToolTip(tr(""));
     objTypeComboBox->clear();
-    for (int i = 0 ; i< MASK_TPYE_NUM ; ++i)
+    for (int i = 0 ; i< _mask_classes.count() ; ++i)
     {
-        objTypeComboBox->addItem(QString(S_mask_types[i].c_str()));
-        objTypeComboBox->setItemData(i , mask_type_tool_tips[i] ,Qt::ToolTipRole);
+        objTypeComboBox->addItem(_mask_classes.name(i));
+        objTypeComboBox->setItemData(i , _mask_classes.tool_tip(i) ,Qt::ToolTipRole);
     }
 }
 
 QString MainWindow::get_mask_file(int obj_id, QString img_file) const
 {
-    return img_file.replace(".image.", ".").section(".", 0, -2) + ".mask." + QString(S_mask_types[obj_id].c_str()) + ".png";
+    return MaskIndex::mask_file_name(img_file, _mask_classes.name(obj_id));
+}
+
+QStringList MainWindow::get_mask_type_names() const
+{
+    return _mask_classes.names();
 }
 
 QString MainWindow::get_current_direction() const
 {
-    QTreeWidgetItem *current = imgTreeWidget->currentItem();
-    if (!current || !current->parent())
+    QModelIndex current = imgTreeView->currentIndex();
+    if (!_image_model->is_image(current))
     {
         return "";
     }
     else
     {
-        QString dir = current->parent()->text(0);
-        return dir;
+        return _image_model->directory(current);
     }
 }
 
 QString MainWindow::get_current_file() const
 {
-    QTreeWidgetItem *current = imgTreeWidget->currentItem();
-    if (!current || !current->parent())
+    QModelIndex current = imgTreeView->currentIndex();
+    if (!_image_model->is_image(current))
     {
         return "";
     }
     else
     {
-        return current->text(0);
+        return _image_model->file(current);
     }
 }
 
@@ -227,6 +310,12 @@ void MainWindow::on_actionOpenDir_triggered()
     // save the opened path
     _current_opened_direction = opened_dir;
 
+    // the lesion objects belong to the previous directory
+    _component_extractor->cancel();
+    _lesions->clear();
+    _components_class = -1;
+    update_overlay_i();
+
     // read in the directory structure
     refresh_img_tree_i();
 
@@ -241,6 +330,70 @@ void MainWindow::on_actionOpenDir_triggered()
     statusBar()->showMessage("Opened directory structure " + opened_dir, 5 * 1000);
 }
 
+void MainWindow::on_actionLoadAnnotations_triggered()
+{
+    // ask the user for an annotation file .. e.g., the output of a detector
+    QString file = QFileDialog::getOpenFileName(this, "Choose an annotation file to be shown", _current_opened_direction, "Annotation files (*.annotation);;All files (*)");
+    if (file.isEmpty())
+    {
+        return;
+    }
+
+    _annotation->loadFromFile(file);
+    update_overlay_i();
+
+    statusBar()->showMessage("Loaded annotations from " + file, 5 * 1000);
+}
+
+void MainWindow::on_overlayCheckBox_toggled(bool checked)
+{
+    _pixmap_widget->set_overlay_visible(checked);
+}
+
+void MainWindow::on_scoreSpinBox_valueChanged(double value)
+{
+    // the minimum stands for 'all', also objects with lower scores
+    if (value <= scoreSpinBox->minimum())
+    {
+        _pixmap_widget->set_overlay_score_threshold(-1e300);
+    }
+    else
+    {
+        _pixmap_widget->set_overlay_score_threshold(value);
+    }
+}
+
+void MainWindow::update_overlay_i()
+{
+    // find the current image in the annotations .. the directories might be
+    // stored with or without the leading "./" or as absolute path
+    QString iFile = get_current_file();
+    QString iDir = get_current_direction();
+    IAFileHandle handle = IA_INVALID_HANDLE;
+    if (!iFile.isEmpty() && !iDir.isEmpty())
+    {
+        handle = _annotation->fileHandle(iDir, iFile);
+        if (handle == IA_INVALID_HANDLE && iDir.startsWith("./"))
+        {
+            handle = _annotation->fileHandle(iDir.mid(2), iFile);
+        }
+        if (handle == IA_INVALID_HANDLE)
+        {
+            handle = _annotation->fileHandle(QDir::cleanPath(_current_opened_direction + iDir), iFile);
+        }
+    }
+    _pixmap_widget->set_overlay(_annotation, handle);
+
+    // the lesion objects are stored under the names of the image list .. the
+    // entry is created right away, so objects that come in later are shown
+    IAFileHandle lesion_handle = IA_INVALID_HANDLE;
+    if (!iFile.isEmpty() && !iDir.isEmpty())
+    {
+        lesion_handle = _lesions->createFile(iDir, iFile);
+    }
+    _pixmap_widget->set_lesion_overlay(_lesions, lesion_handle);
+}
+
 void MainWindow::on_actionQuit_triggered()
 {
     close();
@@ -295,10 +448,9 @@ void MainWindow::on_actionUndo_triggered()
 
         // save the image from the history
         _current_history_img++;
-        if (!_img_undo_history[_current_history_img].save(_current_opened_direction + iDir + "/" + objMaskFilename, "PNG")) {
-            show_mask_error_message_i();
-            return;
-        }
+        _working_set->set_mask(iDir + "/" + iFile, get_current_obj_id(), _current_opened_direction + iDir + "/" + objMaskFilename, _img_undo_history[_current_history_img], true);
+        _mask_index->update_mask(iDir + "/" + iFile, get_current_obj_id(), _img_undo_history[_current_history_img]);
+        update_components_i(iDir + "/" + iFile, get_current_obj_id(), _img_undo_history[_current_history_img], QRect());
 
         refresh_obj_mask_i();
         update_undo_redo_menu();
@@ -318,10 +470,9 @@ void MainWindow::on_actionRedo_triggered()
 
         // save the image from the history
         _current_history_img--;
-        if (!_img_undo_history[_current_history_img].save(_current_opened_direction + iDir + "/" + objMaskFilename, "PNG")) {
-            show_mask_error_message_i();
-            return;
-        }
+        _working_set->set_mask(iDir + "/" + iFile, get_current_obj_id(), _current_opened_direction + iDir + "/" + objMaskFilename, _img_undo_history[_current_history_img], true);
+        _mask_index->update_mask(iDir + "/" + iFile, get_current_obj_id(), _img_undo_history[_current_history_img]);
+        update_components_i(iDir + "/" + iFile, get_current_obj_id(), _img_undo_history[_current_history_img], QRect());
 
         refresh_obj_mask_i();
         update_undo_redo_menu();
@@ -350,8 +501,9 @@ void MainWindow::on_objTypeComboBox_currentIndexChanged(int obj_id)
         // create a new segmentation mask
         if (empty_obj_file)
         {
-            QImage orgImg(_current_opened_direction + iDir + "/" + iFile);
-            QImage mask(orgImg.size(), QImage::Format_Indexed8);
+            // the size is known from the shown image (or its preview) .. no
+            // need to decode the image again
+            QImage mask(_pixmap_widget->get_image_size(), QImage::Format_Indexed8);
             mask.setColorTable(_color_table);
             mask.fill(BACKGROUND);
             //mask.setText("annotationObjType", objTypes[0]);
@@ -362,6 +514,9 @@ void MainWindow::on_objTypeComboBox_currentIndexChanged(int obj_id)
                 return;
             }
             _current_obj_file_collection[obj_id] = objMaskFilename;
+            _mask_index->update_mask(iDir + "/" + iFile, obj_id, mask);
+            _mask_index->update_mtime(iDir + "/" + iFile, obj_id);
+            _working_set->set_mask(iDir + "/" + iFile, obj_id, _current_opened_direction + iDir + "/" + objMaskFilename, mask, false);
         }
 
 
@@ -374,11 +529,50 @@ void MainWindow::on_objTypeComboBox_currentIndexChanged(int obj_id)
         _img_undo_history.push_front(maskImg);
         _current_history_img = 0;
         update_undo_redo_menu();
+        _memory_budget->set_usage(_undo_cache, get_undo_bytes_i());
+
+    }
+
+    // the filter depends on the current mask type
+    if (filterComboBox->currentIndex() > 0)
+        slot_apply_img_tree_filter_i();
+}
 
+void MainWindow::on_filterComboBox_currentIndexChanged(int)
+{
+    slot_apply_img_tree_filter_i();
+}
+
+void MainWindow::slot_apply_img_tree_filter_i()
+{
+    // show/hide the image entries according to the mask index .. the mask
+    // files themselves are not touched here. the image being worked on stays
+    // in the list, otherwise labeling it would switch to the next one
+    const int mode = filterComboBox->currentIndex();
+    const int obj_id = objTypeComboBox->currentIndex();
+    const QString currentDir = get_current_direction();
+    const QString currentFile = get_current_file();
+    for (int i = 0; i < _image_model->directory_count(); ++i)
+    {
+        QString dir = _image_model->directory_name(i);
+        QStringList files = _image_model->files(i);
+        QVector<bool> visible(files.size(), true);
+        if (mode > 0 && obj_id >= 0)
+        {
+            for (int j = 0; j < files.size(); ++j)
+            {
+                if (dir == currentDir && files[j] == currentFile)
+                    continue;
+                bool has_labels = _mask_index->has_labels(dir + "/" + files[j], obj_id);
+                visible[j] = (mode == 1) ? !has_labels : has_labels;
+            }
+        }
+        _image_model->set_visible(i, visible);
     }
+    _thumbnail_timer->start();
 }
 
-void MainWindow::on_imgTreeWidget_currentItemChanged(QTreeWidgetItem *current, QTreeWidgetItem *previous)
+void MainWindow::slot_current_image_changed_i(const QModelIndex &, const QModelIndex &)
 {
     // check weather dir/file/object have been selected
     QString iFile = get_current_file();
@@ -394,7 +588,52 @@ void MainWindow::on_imgTreeWidget_currentItemChanged(QTreeWidgetItem *current, Q
     // load new file
     QString filepath(absoluteDir + iDir + "/" + iFile);
     _pixmap_widget->enable_painting(false);
-    _pixmap_widget->set_pixmap(QPixmap(filepath  ));
+    _pixmap_widget->set_view(QImage());
+
+    // an image of the working set is shown right away .. otherwise show a
+    // reduced decode (or nothing) first, the full image follows from the
+    // loader, the mask is at full size and editable right away
+    QString image_id = iDir + "/" + iFile;
+    QImage picture = _working_set->picture(image_id);
+    QSize image_size;
+    QImage preview;
+    if (picture.isNull())
+        preview = ImageLoader::read_preview(filepath, IMAGE_PREVIEW_SIZE, image_size);
+    if (!picture.isNull())
+    {
+        _image_loader->cancel();
+        _loading_image.clear();
+        _pixmap_widget->set_pixmap(QPixmap::fromImage(picture));
+    }
+    else if (!image_size.isValid())
+    {
+        // no size without decoding .. load it as before
+        _image_loader->cancel();
+        _loading_image.clear();
+        QImage image(filepath);
+        if (!image.isNull())
+            _working_set->set_picture(image_id, image);
+        _pixmap_widget->set_pixmap(QPixmap::fromImage(image));
+    }
+    else
+    {
+        _pixmap_widget->set_pixmap(QPixmap::fromImage(preview), image_size);
+        if (preview.size() == image_size)
+        {
+            _image_loader->cancel();
+            _loading_image.clear();
+            _working_set->set_picture(image_id, preview);
+        }
+        else
+        {
+            _loading_image = filepath;
+            _image_loader->start(filepath);
+            statusBar()->showMessage("Loading " + iFile + " ...");
+        }
+    }
+    update_overlay_i();
+    update_view_i();
+    update_superpixels_i();
 
      //get mask file
     get_mask_files();
@@ -461,7 +700,9 @@ void MainWindow::refresh_img_tree_i()
     std::cout << std::endl;
 
     // clear all items
-    imgTreeWidget->clear();
+    _thumbnail_items.clear();
+    _image_model->set_directories(QStringList(), QList<QStringList>());
+    _mask_index->close();
 
     // read in the currently opened directory structure recursively
     QStringList dirs;
@@ -480,10 +721,20 @@ void MainWindow::refresh_img_tree_i()
         }
     }
 
+    // watch the directories for images that are added/removed later on
+    if (!_dir_watcher->directories().isEmpty())
+        _dir_watcher->removePaths(_dir_watcher->directories());
+    _watched_dirs.clear();
+    _watched_entries.clear();
+    _changed_dirs.clear();
+    for (int i = 0; i < dirs.size(); i++)
+        watch_dir_i(dirs[i]);
+
     // read in all images in all collected directories
-    // add all files and directories to the QTreeWidget
-    QStringList nameFilters;
-    nameFilters << "*.jpg" << "*.png" << "*.bmp" << "*.jpeg" << "*.tif" << "*.gif" << "*.tiff" << "*.pbm" << "*.pgm" << "*.ppm" << "*.xbm" << "*.xpm";
+    // and hand them over to the image model
+    QStringList nameFilters = get_image_name_filters_i();
+    QStringList imageDirs;
+    QList<QStringList> imageFiles;
     for (int i = 0; i < dirs.size(); i++) {
         // get all images in the current directory
         QDir currentDir(_current_opened_direction + dirs[i]);
@@ -495,25 +746,109 @@ void MainWindow::refresh_img_tree_i()
         if (files.size() <= 0)
             continue;
 
-        // construct a new directory entry
-        QTreeWidgetItem *currentTreeDir = new QTreeWidgetItem(imgTreeWidget);
-        imgTreeWidget->setItemExpanded(currentTreeDir, true);
-        currentTreeDir->setText(0, dirs[i]);
-
-        // construct new entries for the image files
+        // collect the image files .. the model keeps them sorted
+        QStringList images;
         for (int j = 0; j < files.size(); j++) {
             // make sure that the image file is not a mask
             if (files[j].contains(".mask."))
                 continue;
-
-            // construct a new entry
-            QTreeWidgetItem *currentFile = new QTreeWidgetItem(currentTreeDir);
-            currentFile->setText(0, files[j]);
+            images << files[j];
         }
+        imageDirs << dirs[i];
+        imageFiles << images;
+    }
+    _image_model->set_directories(imageDirs, imageFiles);
+    imgTreeView->expandAll();
+
+    // (re)index the masks of all images in the background
+    _mask_index->open(_current_opened_direction, get_image_list_i(), get_mask_type_names());
+    slot_apply_img_tree_filter_i();
+}
+
+QStringList MainWindow::get_image_list_i() const
+{
+    // all images of the tree as "<dir>/<file>"
+    return _image_model->images();
+}
+
+void MainWindow::update_components_i(const QString &image, int class_id, const QImage &mask, const QRect &dirty)
+{
+    // keep the lesion objects of the current image/mask type up to date ..
+    // after a stroke only the touched region is labeled again, and only the
+    // objects of the components that changed are replaced
+    if (class_id < 0)
+    {
+        return;
+    }
+
+    if (image != _components_image || class_id != _components_class || dirty.isNull())
+    {
+        _components = MaskLabeler::label(mask);
+        _components_image = image;
+        _components_class = class_id;
+    }
+    else
+    {
+        MaskLabeler::relabel(mask, dirty, _components);
+    }
+    MaskLabeler::apply(_lesions, image, _mask_classes.name(class_id), _components);
+}
+
+void MainWindow::on_actionExtractObjects_triggered()
+{
+    if (_current_opened_direction.isEmpty())
+    {
+        return;
+    }
+
+    // label all masks of all images in the background .. they are read
+    // from disk, so write the pending edits first
+    _working_set->flush();
+    _components_class = -1;
+    _component_extractor->start(_current_opened_direction, get_image_list_i(), get_mask_type_names());
+}
+
+void MainWindow::on_actionExportOutlines_triggered()
+{
+    QString iFile = get_current_file();
+    QString iDir = get_current_direction();
+    int iObj = get_current_obj_id();
+    if (iFile.isEmpty() || iDir.isEmpty() || iObj < 0)
+    {
+        return;
+    }
+
+    // export the outlines of the current mask next to the mask file
+    QString default_file = _current_opened_direction + iDir + "/" + get_mask_file(iObj, iFile).section(".", 0, -2) + ".svg";
+    QString file = QFileDialog::getSaveFileName(this, "Export the mask outlines", default_file, "SVG files (*.svg)");
+    if (file.isEmpty())
+    {
+        return;
     }
 
-    // sort the files + directories
-    imgTreeWidget->sortItems(0, Qt::AscendingOrder);
+    if (MaskContours::save_svg(_pixmap_widget->get_draw_mask(), file))
+    {
+        statusBar()->showMessage("Exported the mask outlines to " + file, 5 * 1000);
+    }
+    else
+    {
+        show_mask_error_message_i();
+    }
+}
+
+void MainWindow::slot_extraction_progress_i(int done, int total)
+{
+    statusBar()->showMessage("Extracting lesion objects: " + QString::number(done) + " / " + QString::number(total) + " masks");
+}
+
+void MainWindow::slot_extraction_finished_i()
+{
+    int count = 0;
+    for (int i = 0; i < _mask_classes.count(); ++i)
+    {
+        count += _lesions->getObjTypeCount(_mask_classes.name(i));
+    }
+    statusBar()->showMessage("Extracted " + QString::number(count) + " lesion objects from the masks", 5 * 1000);
 }
 
 void MainWindow::refresh_obj_mask_i()
@@ -535,8 +870,14 @@ void MainWindow::refresh_obj_mask_i()
     //}
     //else 
     {
-        // load the mask
-        QImage mask(_current_opened_direction + iDir + "/" + get_current_obj_file());
+        // load the mask .. unless it is still in the working set
+        QImage mask;
+        if (!_working_set->mask(iDir + "/" + iFile, iObj, mask))
+        {
+            QString mask_file = _current_opened_direction + iDir + "/" + get_current_obj_file();
+            mask.load(mask_file);
+            _working_set->set_mask(iDir + "/" + iFile, iObj, mask_file, mask, false);
+        }
         // convert binary masks
         //if (mask.colorCount() == 2) 
         //{
@@ -558,77 +899,28 @@ void MainWindow::refresh_obj_mask_i()
 
 void MainWindow::switch_img_file(MainWindow::Direction direction)
 {
-    // choose the current items from the imgTreeWidget
-    QTreeWidgetItem *current = imgTreeWidget->currentItem();
-    if (!current)
+    // choose the current entry from the imgTreeView
+    QModelIndex current = imgTreeView->currentIndex();
+    if (!current.isValid())
         return;
-    QTreeWidgetItem *currentParent = current->parent();
-
-    if (!currentParent) {
-        // we have a directory selected .. take the first file as current item
-        current = current->child(0);
-        currentParent = current->parent();
-    }
-
-    if (!current || !currentParent)
-        return;
-
-    // get the indeces
-    int iParent = imgTreeWidget->indexOfTopLevelItem(currentParent);
-    int iCurrent = currentParent->indexOfChild(current);
 
-    // select the next file index
-    if (direction == Up)
-        iCurrent--;
-    else
-        iCurrent++;
-
-    // the index may be negative .. in that case we switch the parent as well
-    if (iCurrent < 0) {
-        if (iParent > 0) {
-            // get the directory before
-            iParent--;
-            currentParent = imgTreeWidget->topLevelItem(iParent);
-
-            if (!currentParent)
-                return;
-
-            // get the last item from the directory before
-            iCurrent = currentParent->childCount() - 1;
-        }
-        else
-            // we are at the beginning ..
-            iCurrent = 0;
-    }
-    // the index might be too large .. in that case we switch the parent as well
-    else if (iCurrent >= currentParent->childCount()) {
-        if (iParent < imgTreeWidget->topLevelItemCount() - 1) {
-            // get the next directory
-            iParent++;
-            currentParent = imgTreeWidget->topLevelItem(iParent);
-
-            if (!currentParent)
-                return;
+    // plain index arithmetic in the model .. the entries hidden by the
+    // filter are not part of it, the directory entries are skipped
+    QModelIndex next = _image_model->step(current, direction == Up ? -1 : 1);
 
-            // get the first item from the next directory
-            iCurrent = 0;
-        }
-        else
-            // we are at the end ..
-            iCurrent = currentParent->childCount() - 1;
-    }
-
-    if (!currentParent)
-        return;
-
-    // we handled all special cases thus we may try to set the next current item
-    current = currentParent->child(iCurrent);
-    if (current)
-        imgTreeWidget->setCurrentItem(current);
+    // at the beginning/end of the list we simply stay where we are
+    if (next.isValid())
+        imgTreeView->setCurrentIndex(next);
 }
 
 void MainWindow::closeEvent(QCloseEvent *event)
 {
+    _component_extractor->cancel();
+    _image_loader->cancel();
+    _image_enhancer->cancel();
+    _superpixel_loader->cancel();
+    _working_set->flush();
+    _mask_index->close();
     event->accept();
 }
 
@@ -703,11 +995,15 @@ void MainWindow::wheelEvent(QWheelEvent *event)
         }
         else 
         {
-            // forward the wheelEvent to the zoomSpinBox
+            // zoom in steps of the zoomSpinBox .. but keep the image point
+            // below the cursor in place, the spin box follows the widget
+            double zoom = zoomSpinBox->value();
             if (event->delta() > 0)
-                zoomSpinBox->stepDown();
+                zoom -= zoomSpinBox->singleStep();
             else if (event->delta() < 0)
-                zoomSpinBox->stepUp();
+                zoom += zoomSpinBox->singleStep();
+            zoom = qBound(zoomSpinBox->minimum(), zoom, zoomSpinBox->maximum());
+            _pixmap_widget->zoom_at(zoom, _pixmap_widget->mapFromGlobal(event->globalPos()));
         }
         event->accept();
     }
@@ -763,8 +1059,10 @@ void MainWindow::save_mask_i()
             }
         }
     }
-    // save the mask
-    mask.save(_current_opened_direction + iDir + "/" + _current_obj_file_collection[iObj], "PNG");
+    // keep the mask .. it is written in the background
+    _working_set->set_mask(iDir + "/" + iFile, iObj, _current_opened_direction + iDir + "/" + _current_obj_file_collection[iObj], mask, true);
+    _mask_index->update_mask(iDir + "/" + iFile, iObj, mask);
+    update_components_i(iDir + "/" + iFile, iObj, mask, _pixmap_widget->get_stroke_rect());
 
     // save the image in the history and delete items in case the history
     // is too big
@@ -779,6 +1077,7 @@ void MainWindow::save_mask_i()
         _img_undo_history.pop_back();
 
     update_undo_redo_menu();
+    _memory_budget->set_usage(_undo_cache, get_undo_bytes_i());
 }
 
 void MainWindow::update_undo_redo_menu()
@@ -806,7 +1105,7 @@ std::map<int, QString> MainWindow::get_mask_files()
     // find all mask images for the current image .. they determine the
     // number of objects for one image
     QStringList nameFilters;
-    nameFilters << iFile.replace(".image.", ".").section(".", 0, -2) + ".mask.*.png";
+    nameFilters << MaskIndex::mask_file_prefix(iFile) + "*.png";
     QDir currentDir(_current_opened_direction + iDir);
     currentDir.setFilter(QDir::Files);
     currentDir.setNameFilters(nameFilters);
@@ -814,19 +1113,13 @@ std::map<int, QString> MainWindow::get_mask_files()
     QStringList files = currentDir.entryList();
     qSort(files.begin(), files.end(), maskFileLessThan);
 
+    // the class is the exact part between the image prefix and ".png"
     _current_obj_file_collection.clear();
     for (int i = 0 ; i<files.size()  ;++i)
     {
-        std::string s(files[i].toLocal8Bit());
-        for (int j = 0 ; j< MASK_TPYE_NUM ; ++j)
-        {
-            std::string target = S_mask_types[j];
-            if (s.find(target) != std::string::npos)
-            {
-                _current_obj_file_collection[j] = files[i];
-                break;
-            }
-        }
+        int class_id = _mask_classes.find_mask_file(files[i], iFile);
+        if (class_id >= 0)
+            _current_obj_file_collection[class_id] = files[i];
     }
 
     return _current_obj_file_collection;
@@ -844,3 +1137,399 @@ void MainWindow::on_confidenceCheckBox_stateChanged(int state)
     }
 }
 
+
+void MainWindow::on_outlineCheckBox_toggled(bool checked)
+{
+    _pixmap_widget->set_mask_display_mode(checked ? PixmapWidget::MaskOutline : PixmapWidget::MaskFilled);
+}
+
+void MainWindow::on_toolComboBox_currentIndexChanged(int i)
+{
+    // the entries are in the order of PixmapWidget::Tool
+    if (i < 0)
+        return;
+    _pixmap_widget->set_tool(PixmapWidget::Tool(i));
+    update_superpixels_i();
+}
+
+void MainWindow::on_wandToleranceSlider_valueChanged(int i)
+{
+    _pixmap_widget->set_wand_tolerance(i);
+}
+
+void MainWindow::slot_image_loaded_i(const QString &file, const QImage &image)
+{
+    // the user may have switched to another image meanwhile
+    if (file != _loading_image)
+        return;
+    _loading_image.clear();
+
+    if (image.isNull())
+    {
+        statusBar()->showMessage("Could not load " + file, 5000);
+        return;
+    }
+
+    // same size as the preview .. zoom, pan and the mask stay as they are
+    _pixmap_widget->set_pixmap(QPixmap::fromImage(image));
+    _working_set->set_picture(get_current_direction() + "/" + get_current_file(), image);
+    statusBar()->clearMessage();
+    update_view_i();
+    update_superpixels_i();
+}
+
+void MainWindow::update_view_i()
+{
+    // the enhanced view of the current image .. taken from the working set if
+    // it has been computed before, otherwise it is computed in the background
+    // and shows up tile by tile. without the full image (still loading) it
+    // is started again from slot_image_loaded_i
+    _image_enhancer->cancel();
+    QString image_id = get_current_direction() + "/" + get_current_file();
+    int mode = viewComboBox->currentIndex();
+    if (mode <= ImageEnhancer::Original || get_current_file().isEmpty())
+    {
+        _pixmap_widget->set_view(QImage());
+        return;
+    }
+
+    QImage view = _working_set->view(image_id, mode);
+    _pixmap_widget->set_view(view);
+    if (view.isNull())
+        _image_enhancer->start(image_id, _working_set->picture(image_id), ImageEnhancer::Mode(mode));
+}
+
+void MainWindow::update_superpixels_i()
+{
+    // only needed by the superpixel tool .. read from the cache file next to
+    // the image or computed (and cached) in the background, once the full
+    // image is there
+    _superpixel_loader->cancel();
+    _pixmap_widget->set_superpixels(Superpixels());
+    QString image_id = get_current_direction() + "/" + get_current_file();
+    if (toolComboBox->currentIndex() != PixmapWidget::ToolSuperpixels || get_current_file().isEmpty())
+        return;
+
+    // the loader keeps its cache file next to the image .. so it gets the
+    // absolute path, the id is only used to find the picture
+    QImage picture = _working_set->picture(image_id);
+    if (!picture.isNull())
+        _superpixel_loader->start(get_image_file_i(imgTreeView->currentIndex()), picture);
+}
+
+void MainWindow::slot_superpixels_loaded_i(const QString &file, const Superpixels &superpixels)
+{
+    if (!get_current_file().isEmpty() && file == get_image_file_i(imgTreeView->currentIndex()))
+        _pixmap_widget->set_superpixels(superpixels);
+}
+
+void MainWindow::on_viewComboBox_currentIndexChanged(int)
+{
+    update_view_i();
+}
+
+void MainWindow::slot_view_tile_ready_i(const QString &image, int mode, const QRect &rect, const QImage &tile)
+{
+    if (image == get_current_direction() + "/" + get_current_file() && mode == viewComboBox->currentIndex())
+        _pixmap_widget->set_view_tile(rect, tile);
+}
+
+void MainWindow::slot_view_finished_i(const QString &image, int mode)
+{
+    // complete .. keep it with the picture
+    if (image == get_current_direction() + "/" + get_current_file() && mode == viewComboBox->currentIndex())
+        _working_set->set_view(image, mode, _pixmap_widget->get_view());
+}
+
+qint64 MainWindow::get_undo_bytes_i() const
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < _img_undo_history.size(); ++i)
+        bytes += MemoryBudget::image_bytes(_img_undo_history[i]);
+    return bytes;
+}
+
+qint64 MainWindow::evict(int cache, qint64 bytes)
+{
+    if (cache != _undo_cache)
+        return _memory_budget->usage(cache);
+
+    // drop the oldest undo steps .. the current mask and the redo steps stay
+    qint64 freed = 0;
+    while (freed < bytes && _img_undo_history.size() > _current_history_img + 1)
+    {
+        freed += MemoryBudget::image_bytes(_img_undo_history.back());
+        _img_undo_history.pop_back();
+    }
+    update_undo_redo_menu();
+    return get_undo_bytes_i();
+}
+
+void MainWindow::slot_memory_usage_changed_i(qint64 usage, qint64 limit)
+{
+    QString text = QString("Memory: %1 / %2 MB").arg(usage >> 20).arg(limit >> 20);
+    if (_memory_label->text() != text)
+        _memory_label->setText(text);
+    _memory_label->setToolTip(_memory_budget->report());
+}
+
+void MainWindow::on_actionMemoryLimit_triggered()
+{
+    bool ok = false;
+    int limit_mb = QInputDialog::getInt(this, "Memory Limit", "Memory used for images, masks and caches (MB):",
+        int(_memory_budget->limit() >> 20), 256, 65536, 256, &ok);
+    if (!ok)
+        return;
+
+    QSettings settings("lear", "ImageAnotation");
+    settings.setValue("memory_limit_mb", limit_mb);
+    _memory_budget->set_limit(qint64(limit_mb) << 20);
+}
+
+void MainWindow::slot_mask_flush_failed_i(const QString &file)
+{
+    statusBar()->showMessage("Could not write " + file, 5000);
+    show_mask_error_message_i();
+}
+
+QString MainWindow::get_image_file_i(const QModelIndex &index) const
+{
+    // same as the path of the image that is opened for the entry
+    QString iDir = _image_model->directory(index);
+    QString absoluteDir;
+    if (iDir[0] != '/')
+        absoluteDir = _current_opened_direction;
+    return absoluteDir + iDir + "/" + _image_model->file(index);
+}
+
+void MainWindow::on_actionShowThumbnails_toggled(bool checked)
+{
+    if (checked)
+    {
+        imgTreeView->setIconSize(QSize(THUMBNAIL_SIZE, THUMBNAIL_SIZE));
+        _thumbnail_timer->start();
+    }
+    else
+    {
+        _thumbnail_loader->cancel();
+        QHash<QString, QPersistentModelIndex>::const_iterator it;
+        for (it = _thumbnail_items.constBegin(); it != _thumbnail_items.constEnd(); ++it)
+            _image_model->set_icon(it.value(), QIcon());
+        _thumbnail_items.clear();
+        imgTreeView->setIconSize(QSize());
+    }
+}
+
+void MainWindow::slot_update_thumbnails_i()
+{
+    if (!actionShowThumbnails->isChecked())
+        return;
+
+    // walk the entries on the screen and one page below .. the visible ones
+    // get their icons, the others are only prefetched
+    QHash<QString, QPersistentModelIndex> visible;
+    QStringList missing;
+    QStringList prefetch;
+    const int height = imgTreeView->viewport()->height();
+    for (QModelIndex index = imgTreeView->indexAt(QPoint(0, 0)); index.isValid(); index = imgTreeView->indexBelow(index))
+    {
+        int top = imgTreeView->visualRect(index).top();
+        if (top > 2 * height)
+            break;
+        if (!_image_model->is_image(index))
+            continue;
+
+        QString file = get_image_file_i(index);
+        QImage thumbnail = _thumbnail_loader->thumbnail(file);
+        if (top > height)
+        {
+            if (thumbnail.isNull())
+                prefetch << file;
+            continue;
+        }
+
+        visible.insert(file, index);
+        if (thumbnail.isNull())
+            missing << file;
+        else if (!_image_model->has_icon(index))
+            _image_model->set_icon(index, QIcon(QPixmap::fromImage(thumbnail)));
+    }
+
+    // entries that have been scrolled out give their icons back
+    QHash<QString, QPersistentModelIndex>::const_iterator it;
+    for (it = _thumbnail_items.constBegin(); it != _thumbnail_items.constEnd(); ++it)
+    {
+        if (!visible.contains(it.key()))
+            _image_model->set_icon(it.value(), QIcon());
+    }
+    _thumbnail_items = visible;
+
+    _thumbnail_loader->request(missing + prefetch);
+}
+
+void MainWindow::slot_thumbnail_ready_i(const QString &file, const QImage &thumbnail)
+{
+    // the entry is invalid if it is gone in the meantime
+    QPersistentModelIndex index = _thumbnail_items.value(file);
+    if (index.isValid())
+        _image_model->set_icon(index, QIcon(QPixmap::fromImage(thumbnail)));
+}
+
+QStringList MainWindow::get_image_name_filters_i() const
+{
+    QStringList nameFilters;
+    nameFilters << "*.jpg" << "*.png" << "*.bmp" << "*.jpeg" << "*.tif" << "*.gif" << "*.tiff" << "*.pbm" << "*.pgm" << "*.ppm" << "*.xbm" << "*.xpm";
+    return nameFilters;
+}
+
+void MainWindow::watch_dir_i(const QString &dir)
+{
+    // dir is relative to the opened directory, like the tree entries
+    QString path = QDir::cleanPath(_current_opened_direction + dir);
+    _watched_dirs.insert(path, dir);
+    _watched_entries.insert(dir);
+    _dir_watcher->addPath(path);
+}
+
+void MainWindow::slot_directory_changed_i(const QString &path)
+{
+    // the timer is not restarted .. a long copy still shows up every second
+    _changed_dirs.insert(path);
+    if (!_dir_timer->isActive())
+        _dir_timer->start();
+}
+
+void MainWindow::slot_apply_directory_changes_i()
+{
+    QStringList removedImages;
+    QStringList changedImages;
+
+    QStringList paths = _changed_dirs.toList();
+    _changed_dirs.clear();
+    for (int i = 0; i < paths.size(); ++i)
+    {
+        if (!_watched_dirs.contains(paths[i]))
+            continue;
+        QString dir = _watched_dirs.value(paths[i]);
+
+        if (!QDir(paths[i]).exists())
+        {
+            // the directory is gone together with everything below it
+            QStringList watched;
+            QSet<QString>::const_iterator it;
+            for (it = _watched_entries.constBegin(); it != _watched_entries.constEnd(); ++it)
+            {
+                if (*it == dir || it->startsWith(dir + "/"))
+                    watched << *it;
+            }
+            for (int j = 0; j < watched.size(); ++j)
+            {
+                QString path = QDir::cleanPath(_current_opened_direction + watched[j]);
+                _watched_dirs.remove(path);
+                _watched_entries.remove(watched[j]);
+                _dir_watcher->removePath(path);
+                sync_dir_items_i(watched[j], removedImages, changedImages);
+            }
+            continue;
+        }
+
+        // new sub directories are watched and read in as well
+        QStringList dirs;
+        dirs << dir;
+        while (!dirs.isEmpty())
+        {
+            QString current = dirs.takeFirst();
+            if (current != dir && _watched_entries.contains(current))
+                continue;
+            if (current != dir)
+                watch_dir_i(current);
+            sync_dir_items_i(current, removedImages, changedImages);
+
+            QStringList subDirs = QDir(_current_opened_direction + current).entryList(QDir::AllDirs | QDir::NoDotAndDotDot);
+            for (int j = 0; j < subDirs.size(); ++j)
+            {
+                QString sub = current + "/" + subDirs[j];
+                if (!_watched_dirs.contains(QDir::cleanPath(_current_opened_direction + sub)))
+                    dirs << sub;
+            }
+        }
+    }
+
+    _mask_index->update_images(removedImages, changedImages);
+    if (!removedImages.isEmpty() || !changedImages.isEmpty())
+        slot_apply_img_tree_filter_i();
+}
+
+void MainWindow::sync_dir_items_i(const QString &dir, QStringList &removedImages, QStringList &changedImages)
+{
+    // the images the model knows of (hidden ones included)
+    QStringList knownFiles;
+    for (int i = 0; i < _image_model->directory_count(); ++i)
+    {
+        if (_image_model->directory_name(i) == dir)
+        {
+            knownFiles = _image_model->files(i);
+            break;
+        }
+    }
+    bool shown = _image_model->directory_index(dir).isValid();
+
+    // the images and the mask files currently in the directory
+    QStringList files;
+    QHash<QString, qint64> maskTimes;
+    QDir currentDir(_current_opened_direction + dir);
+    if (currentDir.exists())
+    {
+        currentDir.setFilter(QDir::Files);
+        currentDir.setNameFilters(get_image_name_filters_i());
+        QFileInfoList infos = currentDir.entryInfoList();
+        for (int i = 0; i < infos.size(); ++i)
+        {
+            QString name = infos[i].fileName();
+            if (name.contains(".mask."))
+                maskTimes.insert(name, infos[i].lastModified().toMSecsSinceEpoch());
+            else
+                files << name;
+        }
+    }
+
+    // the images that are gone (or renamed) .. their entries (and thumbnail
+    // entries) vanish when the model gets the new list
+    QSet<QString> present = files.toSet();
+    QSet<QString> known = knownFiles.toSet();
+    for (int i = 0; i < knownFiles.size(); ++i)
+    {
+        if (!present.contains(knownFiles[i]))
+            removedImages << dir + "/" + knownFiles[i];
+    }
+
+    // the new ones .. and the images whose masks changed on disk
+    for (int i = 0; i < files.size(); ++i)
+    {
+        QString image = dir + "/" + files[i];
+        if (!known.contains(files[i]))
+        {
+            changedImages << image;
+            continue;
+        }
+
+        for (int j = 0; j < _mask_classes.count(); ++j)
+        {
+            MaskClassInfo info = _mask_index->info(image, j);
+            QString maskFile = get_mask_file(j, files[i]);
+            bool exists = maskTimes.contains(maskFile);
+            // a mask we are still writing is up to date in the index
+            if (info.mtime == MASK_MTIME_PENDING)
+                continue;
+            if (exists != info.exists || (exists && maskTimes.value(maskFile) != info.mtime))
+            {
+                changedImages << image;
+                break;
+            }
+        }
+    }
+
+    _image_model->set_files(dir, files);
+    if (!shown && !files.isEmpty())
+        imgTreeView->expand(_image_model->directory_index(dir));
+}
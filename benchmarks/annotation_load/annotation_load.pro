@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Load/save benchmark of ImgAnnotation on a synthetic annotation file
+#
+#   annotation_load [number of objects, default 1000000]
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = annotation_load
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ../../ImageAnotation
+
+SOURCES += main.cpp \
+    ../../ImageAnotation/ImgAnnotation.cpp \
+    ../../ImageAnotation/AtomicFile.cpp
+
+HEADERS  += ../../ImageAnotation/ImgAnnotation.h \
+    ../../ImageAnotation/AtomicFile.h
@@ -0,0 +1,233 @@
+/**
+* The Image Annotation Tool for image annotations with pixelwise masks
+*
+* Copyright (C) 2007 Alexander Klaeser
+*
+* http://lear.inrialpes.fr/people/klaeser/
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+#include <iostream>
+#include <stdlib.h>
+#include <QCoreApplication>
+#include <QFile>
+#include <QDir>
+#include <QTextStream>
+#include <QRegExp>
+#include <QStringList>
+#include <QHash>
+#include <QList>
+#include <QPointF>
+#include <QRectF>
+#include <QElapsedTimer>
+
+#include "ImgAnnotation.h"
+
+#define BENCHMARK_OBJECTS 1000000
+#define BENCHMARK_FILES 1000
+#define BENCHMARK_DIRS 10
+
+namespace
+{
+    // detector output like .. a few types, many distinct tags, some fix
+    // points and a score per object
+    bool write_synthetic_file(const QString &filepath, int nObjects)
+    {
+        QFile file(filepath);
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+
+        const char *types[] = { "microaneurysm", "hemorrhage", "exudate", "drusen", "vessel", "lesion", "unknown", "artifact" };
+        QByteArray chunk;
+        char line[256];
+        srand(4711);
+        for (int i = 0; i < nObjects; i++) {
+            if (i % (nObjects / BENCHMARK_FILES + 1) == 0) {
+                int iFile = i / (nObjects / BENCHMARK_FILES + 1);
+                qsnprintf(line, sizeof(line), "########## NEW FILE ##########\nfile: images/dir%d/image%05d.tif\n\n", iFile % BENCHMARK_DIRS, iFile);
+                chunk += line;
+            }
+
+            double x = rand() % 4000, y = rand() % 3000;
+            double w = 1 + rand() % 200, h = 1 + rand() % 200;
+            qsnprintf(line, sizeof(line),
+                "object: %s\nminXYMaxXY: %g, %g, %g, %g\ntags: detector_%d, batch_%d\n"
+                "fixPointsXY: %g, %g, %g, %g, %g, %g, %g, %g\nscore: %g\n\n",
+                types[i % 8], x, y, x + w, y + h, i % 5000, i % 37,
+                x, y, x + w, y, x + w, y + h, x, y + h, (rand() % 1000) / 1000.0);
+            chunk += line;
+            if (chunk.size() > (1 << 22)) {
+                file.write(chunk);
+                chunk.clear();
+            }
+        }
+        file.write(chunk);
+        return file.error() == QFile::NoError;
+    }
+
+    class LegacyObj
+    {
+    public:
+        QString type;
+        QRectF box;
+        QStringList tags;
+        QList<QPointF> fixPoints;
+        double score;
+    };
+
+    // the line by line parsing ImgAnnotation::loadFromFile used to do ..
+    // kept here as the reference the in place parser is compared with
+    int legacy_load(const QString &filepath)
+    {
+        QFile file(filepath);
+        if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+            return 0;
+
+        QHash<QString, QHash<QString, QList<LegacyObj> > > dirs;
+        QList<LegacyObj> *currentFile = NULL;
+        LegacyObj *currentObj = NULL;
+        int nObjects = 0;
+
+        QTextStream in(&file);
+        while (!in.atEnd()) {
+            QString line = in.readLine().trimmed();
+            if (line.isEmpty() || line.startsWith("#"))
+                continue;
+
+            QString key = line.section(':', 0, 0).trimmed().toLower();
+            QString value = line.section(':', 1, -1).trimmed();
+            if (key == "file") {
+                currentFile = &dirs[value.section('/', 0, -2)][value.section('/', -1)];
+                currentObj = NULL;
+            }
+            else if (key == "object") {
+                if (currentFile == NULL)
+                    continue;
+                LegacyObj obj;
+                obj.type = value;
+                obj.score = 0;
+                *currentFile << obj;
+                currentObj = &currentFile->last();
+                nObjects++;
+            }
+            else if (key == "minxymaxxy") {
+                if (currentObj == NULL)
+                    continue;
+                currentObj->box.setLeft(value.section(',', 0, 0).trimmed().toFloat());
+                currentObj->box.setTop(value.section(',', 1, 1).trimmed().toFloat());
+                currentObj->box.setRight(value.section(',', 2, 2).trimmed().toFloat());
+                currentObj->box.setBottom(value.section(',', 3, 3).trimmed().toFloat());
+            }
+            else if (key == "tags") {
+                if (currentObj == NULL)
+                    continue;
+                currentObj->tags = value.split(QRegExp("\\s*,\\s*"), QString::SkipEmptyParts);
+            }
+            else if (key == "fixpointsxy") {
+                if (currentObj == NULL)
+                    continue;
+                QStringList points = value.split(QRegExp("\\s*,\\s*"), QString::SkipEmptyParts);
+                for (int i = 0; i < points.count() - 1; i += 2)
+                    currentObj->fixPoints << QPointF(points[i].trimmed().toFloat(), points[i + 1].trimmed().toFloat());
+            }
+            else if (key == "score") {
+                if (currentObj == NULL)
+                    continue;
+                currentObj->score = value.toDouble();
+            }
+        }
+        return nObjects;
+    }
+
+    int count_objects(ImgAnnotation &annotation)
+    {
+        int nObjects = 0;
+        QList<QString> dirs = annotation.getDirs();
+        for (int i = 0; i < dirs.size(); i++) {
+            QList<QString> files = annotation.getDirFiles(dirs[i]);
+            for (int j = 0; j < files.size(); j++)
+                nObjects += annotation.getObj(dirs[i], files[j])->size();
+        }
+        return nObjects;
+    }
+
+    // memory held by the objects and their tag/fix point arrays .. the
+    // interned strings are shared and not part of it
+    qint64 count_bytes(ImgAnnotation &annotation)
+    {
+        qint64 nBytes = 0;
+        QList<QString> dirs = annotation.getDirs();
+        for (int i = 0; i < dirs.size(); i++) {
+            QList<QString> files = annotation.getDirFiles(dirs[i]);
+            for (int j = 0; j < files.size(); j++)
+                nBytes += annotation.getFile(dirs[i], files[j])->byteCount();
+        }
+        return nBytes;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    int nObjects = argc > 1 ? atoi(argv[1]) : BENCHMARK_OBJECTS;
+    if (nObjects <= 0)
+        nObjects = BENCHMARK_OBJECTS;
+
+    QString filepath = QDir::temp().filePath("annotation_load_benchmark.annotation");
+    QString savedpath = filepath + ".saved";
+    QString snapshotpath = filepath + ".snapshot";
+    std::cout << "writing " << nObjects << " objects to " << filepath.toLocal8Bit().data() << std::endl;
+    if (!write_synthetic_file(filepath, nObjects)) {
+        std::cout << "could not write the benchmark file" << std::endl;
+        return 1;
+    }
+
+    QElapsedTimer timer;
+
+    timer.start();
+    int nLegacy = legacy_load(filepath);
+    qint64 legacyMs = timer.elapsed();
+    std::cout << "line by line parser : " << legacyMs << " ms (" << nLegacy << " objects)" << std::endl;
+
+    ImgAnnotation annotation;
+    timer.start();
+    annotation.loadFromFile(filepath);
+    qint64 loadMs = timer.elapsed();
+    std::cout << "loadFromFile        : " << loadMs << " ms (" << count_objects(annotation) << " objects)" << std::endl;
+    if (loadMs > 0)
+        std::cout << "speedup             : " << double(legacyMs) / loadMs << "x" << std::endl;
+    int nLoaded = count_objects(annotation);
+    if (nLoaded > 0)
+        std::cout << "bytes per object    : " << double(count_bytes(annotation)) / nLoaded
+            << " (sizeof(IAObj) " << sizeof(IAObj) << ")" << std::endl;
+
+    timer.start();
+    annotation.saveToFile(savedpath);
+    std::cout << "saveToFile          : " << timer.elapsed() << " ms" << std::endl;
+
+    timer.start();
+    bool saved = annotation.saveSnapshot(snapshotpath);
+    std::cout << "saveSnapshot        : " << timer.elapsed() << " ms" << (saved ? "" : " (failed)") << std::endl;
+
+    ImgAnnotation snapshot;
+    timer.start();
+    bool loaded = snapshot.loadSnapshot(snapshotpath);
+    std::cout << "loadSnapshot        : " << timer.elapsed() << " ms (" << count_objects(snapshot) << " objects)" << (loaded ? "" : " (failed)") << std::endl;
+
+    QFile::remove(filepath);
+    QFile::remove(savedpath);
+    QFile::remove(snapshotpath);
+    return 0;
+}